@@ -99,24 +99,29 @@ std::string parent_directory_anchor(std::string uri, std::string root_path) {
 void http::server::list_directory(const http::server::request &req, http::server::reply &reply,
                                   const std::string &doc_root) {
     try {
-        boost::filesystem::path root = doc_root + req.uri;
+        auto uri = req.uri.to_string();
+        boost::filesystem::path root = doc_root + uri;
         std::ostringstream stream;
-        stream << "<h1>Directory listing of " + req.uri + "</h1>";
-        stream << parent_directory_anchor(req.uri, doc_root);
-        std::vector<boost::filesystem::path> files_in_folder;
-        std::copy(boost::filesystem::directory_iterator(root), boost::filesystem::directory_iterator(),
-                  std::back_inserter(files_in_folder));
-
-        std::sort(files_in_folder.begin(), files_in_folder.end(), [](const auto &p1, const auto &p2) {
-            return boost::filesystem::last_write_time(p1) > boost::filesystem::last_write_time(p2);
-        });
+        stream << "<h1>Directory listing of " + uri + "</h1>";
+        stream << parent_directory_anchor(uri, doc_root);
+        // Stat every entry once instead of on every comparison of the sort.
+        std::vector<std::pair<std::time_t, boost::filesystem::path>> files_in_folder;
+        for (boost::filesystem::directory_iterator it(root), end; it != end; ++it) {
+            boost::system::error_code ec;
+            auto time = boost::filesystem::last_write_time(it->path(), ec);
+            files_in_folder.emplace_back(ec ? 0 : time, it->path());
+        }
+
+        std::sort(files_in_folder.begin(), files_in_folder.end(),
+                  [](const auto &p1, const auto &p2) { return p1.first > p2.first; });
         std::stable_partition(files_in_folder.begin(), files_in_folder.end(),
-                              [](const auto &p) { return boost::filesystem::is_regular_file(p); });
+                              [](const auto &p) { return boost::filesystem::is_regular_file(p.second); });
 
-        for (const auto &p : files_in_folder) {
+        for (const auto &entry : files_in_folder) {
+            const auto &p = entry.second;
             try {
                 stream << "<a href=\"";
-                stream << make_link(req.uri, p) << "\">";
+                stream << make_link(uri, p) << "\">";
                 stream << trim_quotes(make_file_name(p));
                 stream << "</a><br/>";
             } catch (const std::logic_error &) {
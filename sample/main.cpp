@@ -42,8 +42,9 @@ int main(int argc, char *argv[]) {
         std::string cert_root = argv[6];
         std::string compression_folder = argv[7];
         std::vector<user_handler> handlers;
+        // Listing walks the filesystem, so keep it off the io threads.
         handlers.emplace_back(matcher_ptr(new folder{doc_root}),
-                              std::bind(list_directory, std::placeholders::_1, std::placeholders::_2, doc_root));
+                              std::bind(list_directory, std::placeholders::_1, std::placeholders::_2, doc_root), true);
 
         // Initialise the server.
         http::server::server s(address, http_port, https_port, doc_root, cert_root, compression_folder, num_threads, handlers);
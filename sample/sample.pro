@@ -12,6 +12,13 @@ QMAKE_LFLAGS_DEBUG += -std=c++14
 QMAKE_LFLAGS_RELEASE -= -O1
 QMAKE_LFLAGS_RELEASE += -O3 -flto -std=c++14
 
+# Build with "qmake CONFIG+=io_uring" to run every io_service on Asio's io_uring backend instead of
+# epoll. Requires Boost 1.78 or newer and liburing, and must be set for the library and its users alike.
+io_uring {
+    DEFINES += THOR_HAS_IO_URING BOOST_ASIO_HAS_IO_URING BOOST_ASIO_DISABLE_EPOLL
+    LIBS += -luring
+}
+
 SOURCES += main.cpp \
     directory_listing.cpp
 
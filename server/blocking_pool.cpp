@@ -0,0 +1,91 @@
+//
+// blocking_pool.cpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "blocking_pool.hpp"
+#include "log.hpp"
+
+thread_local const http::server::blocking_pool *http::server::blocking_pool::current_pool_ = nullptr;
+thread_local std::size_t http::server::blocking_pool::current_index_ = 0;
+
+http::server::blocking_pool::blocking_pool(std::size_t threads) : pending_(0), next_queue_(0), stopping_(false) {
+    for (std::size_t i = 0; i < threads; ++i)
+        queues_.emplace_back(new queue);
+    for (std::size_t i = 0; i < threads; ++i)
+        threads_.emplace_back([this, i]() { run(i); });
+}
+
+http::server::blocking_pool::~blocking_pool() {
+    {
+        std::lock_guard<std::mutex> hold(idle_mutex_);
+        stopping_ = true;
+    }
+    idle_.notify_all();
+    for (auto &t : threads_)
+        t.join();
+}
+
+void http::server::blocking_pool::submit(http::server::blocking_pool::task t) {
+    if (queues_.empty()) {
+        t();
+        return;
+    }
+
+    auto index = current_pool_ == this ? current_index_ : next_queue_++ % queues_.size();
+    {
+        // Count the task before it becomes visible so that a thread stealing it never sees pending_ underflow.
+        // Taking the idle mutex orders the increment with a thread that is about to sleep.
+        std::lock_guard<std::mutex> hold(idle_mutex_);
+        ++pending_;
+    }
+    {
+        std::lock_guard<std::mutex> hold(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(t));
+    }
+    idle_.notify_one();
+}
+
+bool http::server::blocking_pool::try_pop(std::size_t index, http::server::blocking_pool::task &t) {
+    for (std::size_t n = 0; n < queues_.size(); ++n) {
+        auto &q = *queues_[(index + n) % queues_.size()];
+        std::lock_guard<std::mutex> hold(q.mutex);
+        if (!q.tasks.empty()) {
+            if (n == 0) {
+                t = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            } else {
+                t = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            }
+            --pending_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void http::server::blocking_pool::run(std::size_t index) {
+    current_pool_ = this;
+    current_index_ = index;
+    for (;;) {
+        task t;
+        if (!try_pop(index, t)) {
+            std::unique_lock<std::mutex> lock(idle_mutex_);
+            idle_.wait(lock, [this]() { return pending_ || stopping_; });
+            if (!pending_ && stopping_)
+                return;
+            continue;
+        }
+        try {
+            t();
+        } catch (const std::exception &e) {
+            log::write(std::string("blocking_pool: task threw: ") + e.what());
+        }
+    }
+}
@@ -0,0 +1,74 @@
+//
+// blocking_pool.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef BLOCKING_POOL_HPP
+#define BLOCKING_POOL_HPP
+
+#include <atomic>
+#include <boost/noncopyable.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace http {
+namespace server {
+
+/// A work-stealing thread pool for user handlers that block, so that they never run on an io thread.
+/// Every thread owns a queue. Tasks submitted from a pool thread go to its own queue, other tasks are
+/// spread over the queues, and a thread whose queue is empty steals from the others.
+class blocking_pool : private boost::noncopyable {
+    public:
+    typedef std::function<void()> task;
+
+    /// Start the given number of threads. A pool of size 0 runs every task inline in submit().
+    explicit blocking_pool(std::size_t threads);
+
+    /// Finish the queued tasks and join the threads.
+    ~blocking_pool();
+
+    /// Queue a task. Safe to call from any thread.
+    void submit(task t);
+
+    std::size_t size() const { return queues_.size(); }
+
+    private:
+    struct queue {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    void run(std::size_t index);
+
+    /// Pop from the front of the thread's own queue, then try the backs of the others.
+    bool try_pop(std::size_t index, task &t);
+
+    std::vector<std::unique_ptr<queue>> queues_;
+    std::vector<std::thread> threads_;
+
+    /// Guards sleeping and waking up idle threads.
+    std::mutex idle_mutex_;
+    std::condition_variable idle_;
+
+    std::atomic<std::size_t> pending_;
+    std::atomic<std::size_t> next_queue_;
+    bool stopping_;
+
+    /// The index of the calling thread's queue if it belongs to this pool.
+    static thread_local const blocking_pool *current_pool_;
+    static thread_local std::size_t current_index_;
+};
+}
+}
+
+#endif // BLOCKING_POOL_HPP
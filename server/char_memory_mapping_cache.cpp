@@ -9,25 +9,17 @@
 //
 #include "char_memory_mapping_cache.hpp"
 #include <fcntl.h>
-#include <mutex>
-#include <unordered_map>
 
 std::shared_ptr<http::server::char_memory_mapping> http::server::char_memory_mapping_cache::get(const std::string &path,
                                                                                                 int mode) {
     using namespace std;
-    static unordered_map<string, weak_ptr<char_memory_mapping>> cache;
-    static mutex m;
-
-    lock_guard<mutex> hold(m);
-    auto sp = cache[path].lock();
-    if (!sp) {
-        try {
-            cache[path] = sp = make_shared<char_memory_mapping>(file_descriptor_cache::get(path, mode),
-                                                                boost::filesystem::file_size(path));
-        } catch (const std::system_error &) {
-            throw;
-        }
-    }
-
+    unique_lock<mutex> hold(mutex_, defer_lock);
+    if (synchronized_)
+        hold.lock();
+    auto &entry = cache_[path];
+    auto sp = entry.lock();
+    if (!sp)
+        entry = sp =
+            make_shared<char_memory_mapping>(descriptors_.get(path, mode), boost::filesystem::file_size(path));
     return sp;
 }
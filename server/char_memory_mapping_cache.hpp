@@ -16,8 +16,20 @@
 
 namespace http {
 namespace server {
-struct char_memory_mapping_cache {
-    static std::shared_ptr<char_memory_mapping> get(const std::string &path, int mode);
+/// Memory mappings of files, shared by the replies that send them. The files are opened through the given
+/// descriptor cache. A cache used by a single thread can skip the lock.
+class char_memory_mapping_cache : private boost::noncopyable {
+    public:
+    explicit char_memory_mapping_cache(file_descriptor_cache &descriptors, bool synchronized = true)
+        : descriptors_(descriptors), synchronized_(synchronized) {}
+
+    std::shared_ptr<char_memory_mapping> get(const std::string &path, int mode);
+
+    private:
+    file_descriptor_cache &descriptors_;
+    std::unordered_map<std::string, std::weak_ptr<char_memory_mapping>> cache_;
+    std::mutex mutex_;
+    const bool synchronized_;
 };
 }
 }
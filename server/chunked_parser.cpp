@@ -0,0 +1,110 @@
+//
+// chunked_parser.cpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "chunked_parser.hpp"
+
+http::server::chunked_parser::chunked_parser() : state_(chunk_size_start), remaining_(0) {}
+
+void http::server::chunked_parser::reset() {
+    state_ = chunk_size_start;
+    remaining_ = 0;
+}
+
+boost::logic::tribool http::server::chunked_parser::consume(char input) {
+    switch (state_) {
+    case chunk_size_start:
+        if (hex_value(input) < 0)
+            return false;
+        state_ = chunk_size;
+        remaining_ = hex_value(input);
+        return boost::indeterminate;
+    case chunk_size:
+        if (hex_value(input) >= 0) {
+            // No chunk is anywhere near 2^60 bytes, a size that long is an attack.
+            if (remaining_ >> 59)
+                return false;
+            remaining_ = remaining_ * 16 + hex_value(input);
+            return boost::indeterminate;
+        } else if (input == ';' || input == ' ' || input == '\t') {
+            state_ = chunk_extension;
+            return boost::indeterminate;
+        } else if (input == '\r') {
+            state_ = expecting_size_newline;
+            return boost::indeterminate;
+        } else {
+            return false;
+        }
+    case chunk_extension:
+        if (input == '\r') {
+            state_ = expecting_size_newline;
+            return boost::indeterminate;
+        } else if (is_ctl(input) && input != '\t') {
+            return false;
+        } else {
+            return boost::indeterminate;
+        }
+    case expecting_size_newline:
+        if (input != '\n')
+            return false;
+        // The last chunk has size 0 and is followed by the trailer.
+        state_ = remaining_ ? chunk_data : trailer_line_start;
+        return boost::indeterminate;
+    case expecting_newline_1:
+        if (input != '\r')
+            return false;
+        state_ = expecting_newline_2;
+        return boost::indeterminate;
+    case expecting_newline_2:
+        if (input != '\n')
+            return false;
+        state_ = chunk_size_start;
+        return boost::indeterminate;
+    case trailer_line_start:
+        if (input == '\r') {
+            state_ = expecting_last_newline;
+            return boost::indeterminate;
+        } else if (is_ctl(input)) {
+            return false;
+        } else {
+            state_ = trailer_line;
+            return boost::indeterminate;
+        }
+    case trailer_line:
+        if (input == '\r') {
+            state_ = expecting_trailer_newline;
+            return boost::indeterminate;
+        } else if (is_ctl(input) && input != '\t') {
+            return false;
+        } else {
+            return boost::indeterminate;
+        }
+    case expecting_trailer_newline:
+        if (input != '\n')
+            return false;
+        state_ = trailer_line_start;
+        return boost::indeterminate;
+    case expecting_last_newline:
+        return (input == '\n');
+    default:
+        return false;
+    }
+}
+
+int http::server::chunked_parser::hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool http::server::chunked_parser::is_ctl(int c) { return (c >= 0 && c <= 31) || (c == 127); }
@@ -0,0 +1,89 @@
+//
+// chunked_parser.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef CHUNKED_PARSER_HPP
+#define CHUNKED_PARSER_HPP
+
+#include <algorithm>
+#include <boost/logic/tribool.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <cstddef>
+#include <cstdint>
+
+namespace http {
+namespace server {
+
+/// Parser for request bodies sent with Transfer-Encoding: chunked (RFC 7230, section 4.1). The body is decoded
+/// as it arrives: the data of every chunk is handed out in place, so nothing is buffered however long the body.
+/// Chunk extensions and trailer fields are skipped.
+class chunked_parser {
+    public:
+    /// Construct ready to parse the first chunk size.
+    chunked_parser();
+
+    /// Reset to initial parser state.
+    void reset();
+
+    /// Parse some data, calling data(pointer, size) for every run of chunk data found in it. The tribool return
+    /// value is true when the last chunk and the trailer have been parsed, false if the data is invalid,
+    /// indeterminate when more data is required. The pointer return value indicates how much of the input has
+    /// been consumed: what follows the body is left alone.
+    template <typename DataHandler>
+    boost::tuple<boost::tribool, const char *> parse(const char *begin, const char *end, DataHandler &&data) {
+        while (begin != end) {
+            if (state_ == chunk_data) {
+                auto size = std::min(static_cast<std::uint64_t>(end - begin), remaining_);
+                data(begin, static_cast<std::size_t>(size));
+                begin += size;
+                remaining_ -= size;
+                if (!remaining_)
+                    state_ = expecting_newline_1;
+                continue;
+            }
+            boost::tribool result = consume(*begin++);
+            if (result || !result)
+                return boost::make_tuple(result, begin);
+        }
+        boost::tribool result = boost::indeterminate;
+        return boost::make_tuple(result, begin);
+    }
+
+    private:
+    /// Handle the next character of input outside chunk data.
+    boost::tribool consume(char input);
+
+    /// Get the value of a hexadecimal digit, or -1.
+    static int hex_value(char c);
+
+    /// Check if a byte is an HTTP control character.
+    static bool is_ctl(int c);
+
+    /// The current state of the parser.
+    enum state {
+        chunk_size_start,
+        chunk_size,
+        chunk_extension,
+        expecting_size_newline,
+        chunk_data,
+        expecting_newline_1,
+        expecting_newline_2,
+        trailer_line_start,
+        trailer_line,
+        expecting_trailer_newline,
+        expecting_last_newline
+    } state_;
+
+    /// The size of the chunk being parsed, then what is left of its data.
+    std::uint64_t remaining_;
+};
+}
+}
+
+#endif // CHUNKED_PARSER_HPP
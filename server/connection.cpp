@@ -11,150 +11,678 @@
 
 #include "connection.hpp"
 #include "log.hpp"
-#include <boost/bind.hpp>
-#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
 
-http::server::connection::connection(boost::asio::io_service &io_service, http::server::request_handler &handler)
-    : socket_(io_service), request_handler_(handler), io_service_(io_service) {}
+namespace {
+/// The empty chunk and empty trailer that end a chunked body.
+const char last_chunk[] = {'0', '\r', '\n', '\r', '\n'};
 
-http::server::connection::~connection() {}
+/// The interim response inviting a client that sent Expect: 100-continue to send the body.
+const char continue_line[] = {'H', 'T', 'T', 'P', '/', '1', '.', '1', ' ', '1', '0', '0', ' ',
+                              'C', 'o', 'n', 't', 'i', 'n', 'u', 'e', '\r', '\n', '\r', '\n'};
+}
+
+// Passed by reference to std::chrono::seconds, hence defined.
+constexpr int http::server::connection::keep_alive_seconds;
+constexpr int http::server::connection::body_timeout_seconds;
+
+http::server::connection::connection(http::server::worker &w, http::server::request_handler &handler,
+                                     const http::server::server_options &options)
+    : socket_(w.io_service), request_handler_(handler), buffer_(buffer_size), read_begin_(0), read_end_(0),
+      head_begin_(0), head_end_(0), batch_size_(0),
+      streaming_(false), chunked_(false), io_service_(w.io_service), worker_(w), options_(options), started_(false),
+      responding_(false), corked_(false), body_length_(0), body_remaining_(0), body_handler_(nullptr),
+      body_chunked_(false), reading_body_(false), body_splice_(false), body_failed_(false), body_skipped_(false),
+      send_continue_(false), splice_pipe_{-1, -1}, timeout_([this]() { this->handle_timeout(); }),
+      awaiting_headers_(false), header_timed_out_(false), closing_(false) {
+    request_parser_.limit(options.max_request_line_size, options.max_header_size, options.max_header_count);
+}
+
+http::server::connection::~connection() {
+    end_response();
+    end_connection();
+    close_splice_pipe();
+}
 
 tcp::socket &http::server::connection::socket() { return socket_; }
 
-void http::server::connection::start() { connection::start_reading(); }
+void http::server::connection::recycle() {
+    end_response();
+    end_connection();
+    boost::system::error_code ignored_ec;
+    socket().close(ignored_ec);
+    corked_ = false;
+    timeout_.cancel();
+    awaiting_headers_ = header_timed_out_ = closing_ = false;
+    coroutine_ = boost::asio::coroutine();
+    for (auto &rep : replies_)
+        rep.clear();
+    batch_size_ = 0;
+    parse_result_ = boost::indeterminate;
+    read_begin_ = read_end_ = 0;
+    next_request();
+    // Give back what a large request made the buffer grow to.
+    if (buffer_.size() != buffer_size)
+        std::vector<char>(buffer_size).swap(buffer_);
+    write_buffers_.clear();
+    sendfile_ = {};
+    streaming_ = chunked_ = false;
+    body_length_ = body_remaining_ = 0;
+    body_handler_ = nullptr;
+    body_chunked_ = reading_body_ = body_splice_ = body_failed_ = body_skipped_ = send_continue_ = false;
+    body_file_.reset();
+    close_splice_pipe();
+    chunked_parser_.reset();
+}
+
+void http::server::connection::start() {
+    started_ = true;
+    ++worker_.load.connections;
+    ++worker_.pool_connections;
+    // The listener may run on another worker's thread, and the coroutine must only run on its own.
+    io_service_.dispatch(make_handler());
+}
+
+#include <boost/asio/yield.hpp>
+void http::server::connection::operator()(boost::system::error_code ec, std::size_t bytes_transferred) {
+    // If an error occurs then no new asynchronous operations are started. This
+    // means that all shared_ptr references to the connection object will
+    // disappear and the object will be destroyed automatically after this
+    // handler returns. The connection class's destructor closes the socket.
+    if (closing_)
+        return;
+    if (ec) {
+        if (sendfile_)
+            log::write("connection: sendfile failed: " + ec.message());
+        if (header_timed_out_)
+            reply_timed_out();
+        return;
+    }
+
+    reenter(coroutine_) {
+        await_headers();
+        if (needs_handshake()) {
+            yield async_handshake(make_handler());
+            if (upgrade()) {
+                timeout_.cancel();
+                awaiting_headers_ = false;
+                yield break;
+            }
+        }
+
+        for (;;) {
+            // Parse what is left of the last read before reading more: pipelined requests are often already there.
+            while (boost::indeterminate(parse_result_ = parse_buffered())) {
+                make_room(min_read_size);
+                yield async_read_some(free_buffer(), make_handler());
+                read_end_ += bytes_transferred;
+                await_headers();
+            }
+            timeout_.cancel();
+            awaiting_headers_ = false;
+
+            // Handle the requests that are already buffered, up to the pipeline depth, and send their replies
+            // together. A reply with a file to send, or one that closes the connection, ends the batch.
+            begin_response();
+            batch_size_ = 0;
+            for (;;) {
+                next_reply();
+                if (parse_result_ && begin_body()) {
+                    if (reading_body_ && (batch_size_ > 1 || send_continue_)) {
+                        // The replies to the earlier requests of the batch go out before the body is waited for,
+                        // followed by the interim response if the client waits for one.
+                        write_buffers_.clear();
+                        for (std::size_t i = 0; i + 1 < batch_size_; ++i)
+                            replies_[i].to_buffers(write_buffers_);
+                        if (send_continue_)
+                            write_buffers_.push_back(boost::asio::buffer(continue_line));
+                        yield async_write(const_buffers_view(write_buffers_), make_handler());
+                        restart_batch();
+                    }
+
+                    // The request is complete. Read its body without holding the thread, every read in time.
+                    while (reading_body_) {
+                        worker_.timers.arm(timeout_, std::chrono::seconds(body_timeout_seconds));
+                        yield async_read_body(make_handler());
+                        if (!body_read(bytes_transferred))
+                            break;
+                    }
+                    timeout_.cancel();
+                    body_file_.reset();
+
+                    // A body that could not be read already has its reply.
+                    if (!reading_body_ && !handle_request(current_reply(), make_handler())) {
+                        // Resumed once a blocking or asynchronous handler has finished.
+                        yield;
+                    }
+                } else if (!parse_result_) {
+                    // The request is malformed or over the limits.
+                    current_reply() = reply::stock_reply(parse_error_status());
+                }
+
+                if (worker_.draining || body_skipped_)
+                    close_after(current_reply());
+                next_request();
+
+                if (current_reply().sendfile || current_reply().producer || !wants_keep_alive(current_reply()) ||
+                    batch_size_ >= std::max<std::size_t>(options_.pipeline_depth, 1) || read_begin_ == read_end_)
+                    break;
+                if (boost::indeterminate(parse_result_ = parse_buffered()))
+                    break; // Only the start of the next request is here; the rest is read above.
+            }
+
+            write_buffers_.clear();
+            for (std::size_t i = 0; i < batch_size_; ++i)
+                replies_[i].to_buffers(write_buffers_);
+            if (current_reply().sendfile)
+                sendfile_ = current_reply().sendfile;
+            if (sendfile_ && options_.cork_responses)
+                cork(true);
+            yield async_write(const_buffers_view(write_buffers_), make_handler());
+
+            if (sendfile_) {
+                yield async_sendfile(make_handler());
+                sendfile_ = {};
+            }
+
+            // Stream the body piece by piece: the next one is produced only once the last one has been written.
+            if (current_reply().producer) {
+                {
+                    auto encoding = current_reply().get_header("Transfer-Encoding");
+                    chunked_ = encoding && iequals(encoding->value, "chunked");
+                }
+                streaming_ = true;
+                do {
+                    next_chunk();
+                    yield async_write(const_buffers_view(write_buffers_), make_handler());
+                    current_reply().content.clear();
+                } while (streaming_);
+                if (!chunked_) {
+                    // The end of the connection is the end of the body.
+                    yield break;
+                }
+            }
+            if (corked_)
+                cork(false);
+            end_response();
+
+            // No new asynchronous operations are started. This means that all shared_ptr
+            // references to the connection object will disappear and the object will be
+            // destroyed automatically after this handler returns. The connection class's
+            // destructor closes the socket.
+            if (!wants_keep_alive(current_reply())) {
+                yield break;
+            }
+
+            for (std::size_t i = 0; i < batch_size_; ++i)
+                replies_[i].clear();
+            // What is left of the last read, parsed or not, is the start of the next request, whose headers are due
+            // in time.
+            if (read_end_ == head_begin_)
+                keep_alive();
+            else
+                await_headers();
+        }
+    }
+}
+#include <boost/asio/unyield.hpp>
+
+void http::server::connection::async_handshake(http::server::connection::io_handler handler) {
+    io_service_.post(handler);
+}
+
+void http::server::connection::async_read_some(boost::asio::mutable_buffers_1 buffer,
+                                               http::server::connection::io_handler handler) {
+    socket_.async_read_some(buffer, handler);
+}
+
+void http::server::connection::async_write(http::server::const_buffers_view buffers,
+                                           http::server::connection::io_handler handler) {
+    boost::asio::async_write(socket_, buffers, handler);
+}
+
+bool http::server::connection::handle_request(http::server::reply &rep, http::server::connection::io_handler handler) {
+    return request_handler_.handle_request<request_handler::protocol_type::http>(request_, rep, io_service_,
+                                                                                 handler);
+}
 
-void http::server::connection::start_reading(const boost::system::error_code &) {
-    socket_.async_read_some(boost::asio::buffer(buffer_),
-                            boost::bind(&connection::handle_read, shared_from_this(), boost::asio::placeholders::error,
-                                        boost::asio::placeholders::bytes_transferred));
+bool http::server::connection::async_sendfile(http::server::connection::io_handler handler) {
+    if (!sendfile_)
+        return false;
+    sendfile_.sock_ = &socket_;
+    sendfile_.handler_ = handler;
+    // Try to send straight away: the socket is usually writable right after the headers went out,
+    // and sendfile_op only waits for readiness when the kernel buffer is full.
+    sendfile_op op = sendfile_;
+    op(boost::system::error_code(), 0);
+    return true;
 }
 
 void http::server::connection::keep_alive() {
-    start_reading();
+    awaiting_headers_ = false;
+    worker_.timers.arm(timeout_, std::chrono::seconds(keep_alive_seconds));
+}
+
+void http::server::connection::await_headers() {
+    if (awaiting_headers_)
+        return;
+    awaiting_headers_ = true;
+    worker_.timers.arm(timeout_, std::chrono::seconds(options_.header_timeout_seconds));
+}
 
-    timer_.reset(new boost::asio::deadline_timer(io_service_, boost::posix_time::seconds(keep_alive_seconds)));
+void http::server::connection::close_after(http::server::reply &rep) {
+    if (auto connection_field_ptr = rep.get_header("Connection"))
+        connection_field_ptr->value = "Close";
+}
 
-    auto self = shared_from_this();
-    timer_->async_wait([self, this](const boost::system::error_code &ec) { self->handle_idle_timer(ec); });
+bool http::server::connection::wants_keep_alive(http::server::reply &rep) {
+    auto connection_field_ptr = rep.get_header("Connection");
+    return connection_field_ptr && iequals(connection_field_ptr->value, "keep-alive");
 }
 
-void http::server::connection::keep_alive_if_needed() {
-    if (auto connection_field_ptr = reply_.get_header("Connection")) {
-        if (uppercase(connection_field_ptr->value) == "KEEP-ALIVE") {
-            request_ = {};
-            reply_ = {};
-            request_parser_ = {};
-            keep_alive();
-        }
+void http::server::connection::handle_timeout() {
+    // A client that has started a request without finishing its headers is told why it is disconnected.
+    header_timed_out_ = awaiting_headers_ && !closing_ && read_end_ != head_begin_;
+    // Fails the pending operation, which ends the coroutine.
+    boost::system::error_code ignored_ec;
+    socket().cancel(ignored_ec);
+}
+
+void http::server::connection::reply_timed_out() {
+    header_timed_out_ = awaiting_headers_ = false;
+    closing_ = true;
+    if (replies_.empty())
+        replies_.emplace_back();
+    replies_[0] = reply::stock_reply(reply::status_type::request_timeout);
+    batch_size_ = 1;
+    write_buffers_.clear();
+    replies_[0].to_buffers(write_buffers_);
+    // The client may not read it either.
+    worker_.timers.arm(timeout_, std::chrono::seconds(options_.header_timeout_seconds));
+    async_write(const_buffers_view(write_buffers_), make_handler());
+}
+
+http::server::reply::status_type http::server::connection::parse_error_status() const {
+    switch (request_parser_.last_error()) {
+    case request_parser::error::request_line_too_long:
+        return reply::status_type::uri_too_long;
+    case request_parser::error::header_too_large:
+    case request_parser::error::too_many_headers:
+        return reply::status_type::request_header_fields_too_large;
+    default:
+        return reply::status_type::bad_request;
     }
 }
 
-void http::server::connection::handle_idle_timer(const boost::system::error_code &ec) {
-    if (!ec) {
-        socket_.cancel();
+void http::server::connection::make_room(std::size_t size) {
+    if (head_begin_ == read_end_)
+        head_begin_ = head_end_ = read_begin_ = read_end_ = 0;
+    if (buffer_.size() - read_end_ >= size)
+        return;
+
+    const char *kept = buffer_.data() + head_begin_;
+    auto kept_size = read_end_ - head_begin_;
+    if (kept_size + size <= buffer_.size()) {
+        std::memmove(buffer_.data(), kept, kept_size);
+        request_.rebase(kept, buffer_.data());
+    } else {
+        std::vector<char> larger(std::max(buffer_.size() * 2, kept_size + size));
+        std::memcpy(larger.data(), kept, kept_size);
+        request_.rebase(kept, larger.data());
+        buffer_.swap(larger);
     }
+    read_begin_ -= head_begin_;
+    read_end_ -= head_begin_;
+    head_end_ -= head_begin_;
+    head_begin_ = 0;
 }
 
-void http::server::connection::handle_sendfile_done(const boost::system::error_code &ec, std::size_t) {
-    if (ec)
-        log::write("handle_sendfile_done: " + ec.message());
-    sendfile_ = {};
-    // keep_alive_if_needed();
+void http::server::connection::next_request() {
+    request_.clear();
+    request_parser_.reset();
+    head_begin_ = head_end_ = read_begin_;
 }
 
-void http::server::connection::drain_body(boost::system::error_code &ec) {
-    auto content_len_ptr = request_.get_header("Content-Length");
-    if (content_len_ptr) {
-        auto content_length = boost::lexical_cast<std::size_t>(content_len_ptr->value);
-        auto current_body_size = request_.body.size();
-        auto left = content_length - current_body_size;
-        request_.body.resize(left);
-        sync_read(&request_.body.front(), request_.body.size(), ec);
-    } else {
-        throw std::logic_error{"Request doesn't have a body"};
+boost::tribool http::server::connection::parse_buffered() {
+    if (read_begin_ == read_end_)
+        return boost::indeterminate;
+
+    boost::tribool result;
+    char *data = buffer_.data(), *parsed_end;
+    boost::tie(result, parsed_end) = request_parser_.parse(request_, data + read_begin_, data + read_end_);
+    read_begin_ = parsed_end - data;
+    return result;
+}
+
+void http::server::connection::next_chunk() {
+    auto &rep = current_reply();
+    // Content set by the handler goes out first.
+    if (rep.content.empty())
+        streaming_ = rep.producer(rep.content, std::max<std::size_t>(options_.stream_window, 1));
+
+    write_buffers_.clear();
+    if (!chunked_) {
+        write_buffers_.push_back(boost::asio::buffer(rep.content));
+        return;
+    }
+    if (!rep.content.empty()) {
+        char size[sizeof(std::size_t) * 2 + 3];
+        chunk_size_.assign(size, std::snprintf(size, sizeof(size), "%zx\r\n", rep.content.size()));
+        write_buffers_.push_back(boost::asio::buffer(chunk_size_));
+        write_buffers_.push_back(boost::asio::buffer(rep.content));
+        write_buffers_.push_back(boost::asio::buffer(misc_strings::crlf));
     }
+    if (!streaming_)
+        write_buffers_.push_back(boost::asio::buffer(last_chunk));
 }
 
-void http::server::connection::drain_body_if_needed() {
-    if (request_.get_header("Content-Length") && !request_.body.size()) {
-        boost::system::error_code ignored_ec;
-        drain_body(ignored_ec);
+void http::server::connection::restart_batch() {
+    for (std::size_t i = 0; i + 1 < batch_size_; ++i)
+        replies_[i].clear();
+    std::swap(replies_[0], replies_[batch_size_ - 1]);
+    batch_size_ = 1;
+}
+
+void http::server::connection::next_reply() {
+    if (batch_size_ == replies_.size())
+        replies_.emplace_back();
+    ++batch_size_;
+}
+
+void http::server::connection::cork(bool on) {
+#ifdef TCP_CORK
+    boost::system::error_code ec;
+    socket().set_option(boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_CORK>(on), ec);
+    corked_ = on && !ec;
+#else
+    (void)on;
+#endif
+}
+
+void http::server::connection::end_connection() {
+    if (started_) {
+        started_ = false;
+        --worker_.load.connections;
+        --worker_.pool_connections;
+    }
+}
+
+void http::server::connection::begin_response() {
+    if (!responding_) {
+        responding_ = true;
+        ++worker_.load.queued_handlers;
     }
 }
 
-void http::server::connection::sync_read(char *where, std::size_t bytes, boost::system::error_code &ec) {
-    boost::asio::read(socket_, boost::asio::buffer(where, bytes),
-                      [bytes](const boost::system::error_code &, std::size_t bytes_read) -> std::size_t {
-                          return bytes - bytes_read;
-                      },
-                      ec);
+void http::server::connection::end_response() {
+    if (responding_) {
+        responding_ = false;
+        --worker_.load.queued_handlers;
+    }
 }
 
-void http::server::connection::handle_read(const boost::system::error_code &e, std::size_t bytes_transferred) {
-    timer_.reset();
-    if (!e) {
-        boost::tribool result;
-        boost::tie(result, boost::tuples::ignore) =
-            request_parser_.parse(request_, buffer_.data(), buffer_.data() + bytes_transferred);
+bool http::server::connection::begin_body() {
+    head_end_ = read_begin_;
+    body_length_ = body_remaining_ = 0;
+    body_handler_ = nullptr;
+    body_chunked_ = reading_body_ = body_splice_ = body_failed_ = body_skipped_ = send_continue_ = false;
+    auto content_length = request_.get_header(known_header::content_length);
+    auto transfer_encoding = request_.get_header(known_header::transfer_encoding);
+    if (!content_length && !transfer_encoding)
+        return true;
 
-        request_.read_body_func = [this]() {
-            try {
-                boost::system::error_code ec;
-                drain_body(ec);
-                if (ec)
-                    throw std::system_error{errno, std::system_category()};
-            } catch (...) {
-                throw;
-            }
-        };
-
-        if (result) {
-            // The request is complete.
-            request_handler_.handle_request<request_handler::protocol_type::http>(request_, reply_);
-            drain_body_if_needed();
-            if (reply_.sendfile)
-                sendfile_ = reply_.sendfile;
-            boost::asio::async_write(
-                socket_, reply_.to_buffers(),
-                boost::bind(&connection::handle_write, shared_from_this(), boost::asio::placeholders::error));
-        } else if (!result) {
-            // The request is malformed.
-            reply_ = reply::stock_reply(reply::status_type::bad_request);
-            drain_body_if_needed();
-            boost::asio::async_write(
-                socket_, reply_.to_buffers(),
-                boost::bind(&connection::handle_write, shared_from_this(), boost::asio::placeholders::error));
-        } else {
-            // Need more data.
-            socket_.async_read_some(boost::asio::buffer(buffer_),
-                                    boost::bind(&connection::handle_read, shared_from_this(),
-                                                boost::asio::placeholders::error,
-                                                boost::asio::placeholders::bytes_transferred));
+    // Repeated framing headers let a proxy and the server disagree on where the body ends, and smuggle a request
+    // in the difference.
+    if (request_.is_repeated(known_header::transfer_encoding) ||
+        request_.has_conflicting_values(known_header::content_length)) {
+        current_reply() = reply::stock_reply(reply::status_type::bad_request);
+        return false;
+    }
+    if (transfer_encoding) {
+        // Both headers make the length of the body ambiguous, and chunked is the only coding understood.
+        if (content_length) {
+            current_reply() = reply::stock_reply(reply::status_type::bad_request);
+            return false;
         }
+        if (!iequals(transfer_encoding->value, "chunked")) {
+            current_reply() = reply::stock_reply(reply::status_type::not_implemented);
+            return false;
+        }
+        body_chunked_ = true;
+    } else if (!parse_size(content_length->value, body_length_)) {
+        current_reply() = reply::stock_reply(reply::status_type::bad_request);
+        return false;
     }
 
-    // If an error occurs then no new asynchronous operations are started. This
-    // means that all shared_ptr references to the connection object will
-    // disappear and the object will be destroyed automatically after this
-    // handler returns. The connection class's destructor closes the socket.
-}
+    if (!body_chunked_ && !body_length_)
+        return true;
+
+    // Decide whether the body is wanted before reading any of it, so that a client waiting for 100 Continue never
+    // sends a rejected one.
+    auto handler = request_handler_.get_user_handler(request_);
+    bool expects_continue = false;
+    if (auto expect = request_.get_header(known_header::expect)) {
+        if (!iequals(expect->value, "100-continue")) {
+            current_reply() = reply::stock_reply(reply::status_type::expectation_failed);
+            return false;
+        }
+        // HTTP/1.0 clients do not wait for it.
+        expects_continue = request_.http_version_major > 1 || request_.http_version_minor >= 1;
+    }
+    if (handler && !request_handler_.accepts_body(handler, request_, current_reply())) {
+        // The body is not read, so the connection cannot be used for another request.
+        close_after(current_reply());
+        return false;
+    }
+    if (!handler && expects_continue) {
+        // The static files do not need the body: answer without it, then close the connection.
+        body_skipped_ = true;
+        return true;
+    }
 
-void http::server::connection::handle_write(const boost::system::error_code &e) {
-    if (!e) {
-        if (sendfile_) {
-            sendfile_.sock_ = &socket_;
-            sendfile_.handler_ =
-                boost::bind(&connection::handle_sendfile_done, shared_from_this(), boost::asio::placeholders::error,
-                            boost::asio::placeholders::bytes_transferred);
-            socket_.async_write_some(boost::asio::null_buffers(), sendfile_);
-        } else {
-            keep_alive_if_needed();
+    auto path = handler ? handler->get_body_file(request_) : std::string();
+    if (!path.empty()) {
+        try {
+            body_file_.reset(new file_descriptor(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC));
+        } catch (const std::system_error &e) {
+            log::write("connection: cannot store a request body in " + path + ": " + e.what());
+            current_reply() = reply::stock_reply(reply::status_type::internal_server_error);
+            return false;
         }
+        request_.body_file = path;
+#ifdef __linux__
+        body_splice_ = !body_chunked_ && can_splice() && open_splice_pipe();
+#endif
+    } else if (handler) {
+        body_handler_ = handler->get_body_handler();
+    }
+    if (!body_file_ && !body_handler_ && options_.max_request_body_size &&
+        body_length_ > options_.max_request_body_size) {
+        // Not read either.
+        current_reply() = reply::stock_reply(reply::status_type::payload_too_large);
+        return false;
+    }
+
+    // The start of the body usually arrived with the headers.
+    request_.body.clear();
+    if (body_chunked_) {
+        chunked_parser_.reset();
+        reading_body_ = true;
+        if (!parse_chunked())
+            return false;
+    } else {
+        auto buffered = std::min(body_length_, read_end_ - read_begin_);
+        body_data(buffer_.data() + read_begin_, buffered);
+        read_begin_ += buffered;
+        body_remaining_ = body_length_ - buffered;
+        reading_body_ = body_remaining_ != 0;
+        if (!check_body())
+            return false;
+    }
+
+    send_continue_ = expects_continue && reading_body_;
+    return true;
+}
+
+void http::server::connection::async_read_body(http::server::connection::io_handler handler) {
+    if (body_splice_) {
+        // Only wait for the socket to be readable, the body is then moved by body_read.
+        socket().async_read_some(boost::asio::null_buffers(), handler);
+        return;
+    }
+    if (body_handler_ || body_file_ || body_chunked_) {
+        // What was read of the body has been consumed: read the rest after the headers, which are still in use.
+        read_begin_ = read_end_ = head_end_;
+        make_room(min_read_size);
+        async_read_some(free_buffer(), handler);
+        return;
     }
 
-    // No new asynchronous operations are started. This means that all shared_ptr
-    // references to the connection object will disappear and the object will be
-    // destroyed automatically after this handler returns. The connection class's
-    // destructor closes the socket.
+    // Grow the body as it arrives rather than by the length the client declared, using the capacity left by
+    // earlier requests first.
+    auto offset = body_length_ - body_remaining_;
+    auto room = std::max(request_.body.capacity() - offset, std::size_t(body_read_size));
+    request_.body.resize(offset + std::min(body_remaining_, room));
+    async_read_some(boost::asio::buffer(&request_.body[offset], request_.body.size() - offset), handler);
+}
+
+bool http::server::connection::body_read(std::size_t bytes_transferred) {
+    if (body_splice_) {
+        splice_body();
+        reading_body_ = body_remaining_ != 0;
+        return check_body();
+    }
+    if (body_handler_ || body_file_ || body_chunked_) {
+        read_end_ += bytes_transferred;
+        if (body_chunked_)
+            return parse_chunked();
+        // The read may have gone past the body into the next pipelined request.
+        auto piece = std::min(bytes_transferred, body_remaining_);
+        body_data(buffer_.data() + read_begin_, piece);
+        read_begin_ += piece;
+    } else {
+        request_.body.resize(body_length_ - body_remaining_ + bytes_transferred);
+    }
+    body_remaining_ -= std::min(bytes_transferred, body_remaining_);
+    reading_body_ = body_remaining_ != 0;
+    return check_body();
+}
+
+bool http::server::connection::parse_chunked() {
+    boost::tribool result;
+    const char *parsed_end;
+    boost::tie(result, parsed_end) =
+        chunked_parser_.parse(buffer_.data() + read_begin_, buffer_.data() + read_end_,
+                              [this](const char *data, std::size_t size) { this->body_data(data, size); });
+    read_begin_ = parsed_end - buffer_.data();
+    if (!result) {
+        current_reply() = reply::stock_reply(reply::status_type::bad_request);
+        return false;
+    }
+    reading_body_ = boost::indeterminate(result);
+    return check_body();
+}
+
+void http::server::connection::body_data(const char *data, std::size_t size) {
+    if (!size || body_failed_)
+        return;
+    if (body_file_)
+        body_failed_ = !(body_splice_ ? splice_buffered(data, size) : body_file_->write(data, size));
+    else if (body_handler_)
+        (*body_handler_)(request_, data, size);
+    else
+        request_.body.append(data, size);
+}
+
+bool http::server::connection::check_body() {
+    if (body_failed_) {
+        log::write("connection: storing a request body in " + request_.body_file + " failed");
+        current_reply() = reply::stock_reply(reply::status_type::internal_server_error);
+        return false;
+    }
+    if (!body_file_ && !body_handler_ && options_.max_request_body_size &&
+        request_.body.size() > options_.max_request_body_size) {
+        current_reply() = reply::stock_reply(reply::status_type::payload_too_large);
+        return false;
+    }
+    return true;
+}
+
+#ifdef __linux__
+bool http::server::connection::open_splice_pipe() {
+    if (splice_pipe_[0] != -1)
+        return true;
+    boost::system::error_code ec;
+    socket().native_non_blocking(true, ec);
+    return !ec && ::pipe2(splice_pipe_, O_CLOEXEC) == 0;
+}
+
+void http::server::connection::splice_body() {
+    // Move what the socket has to the file through the pipe, as long as it has something.
+    while (body_remaining_ && !body_failed_) {
+        auto n = ::splice(socket().native_handle(), nullptr, splice_pipe_[1], nullptr,
+                          std::min(body_remaining_, std::size_t(body_read_size)), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        // The client closed the connection or the socket failed: the reply will not get through either.
+        body_failed_ = n <= 0 || !drain_splice_pipe(n);
+        body_remaining_ -= body_failed_ ? 0 : n;
+    }
+}
+
+bool http::server::connection::splice_buffered(const char *data, std::size_t size) {
+    // Hand the pages of buffer_ to the pipe, then move them to the file before buffer_ is reused.
+    while (size) {
+        iovec piece = {const_cast<char *>(data), size};
+        auto n = ::vmsplice(splice_pipe_[1], &piece, 1, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0 || !drain_splice_pipe(n))
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool http::server::connection::drain_splice_pipe(std::size_t size) {
+    while (size) {
+        auto n = ::splice(splice_pipe_[0], nullptr, body_file_->value, nullptr, size, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        size -= n;
+    }
+    return true;
+}
+#else
+bool http::server::connection::open_splice_pipe() { return false; }
+
+void http::server::connection::splice_body() {}
+
+bool http::server::connection::splice_buffered(const char *, std::size_t) { return false; }
+
+bool http::server::connection::drain_splice_pipe(std::size_t) { return false; }
+#endif
+
+void http::server::connection::close_splice_pipe() {
+    for (auto &fd : splice_pipe_) {
+        if (fd != -1)
+            ::close(fd);
+        fd = -1;
+    }
 }
@@ -12,24 +12,36 @@
 #ifndef HTTP_SERVER3_CONNECTION_HPP
 #define HTTP_SERVER3_CONNECTION_HPP
 
+#include "chunked_parser.hpp"
+#include "file_descriptor.hpp"
+#include "handler_memory.hpp"
 #include "reply.hpp"
 #include "request.hpp"
 #include "request_handler.hpp"
 #include "request_parser.hpp"
 #include "sendfile_op.hpp"
-#include <boost/array.hpp>
+#include "server_options.hpp"
+#include "worker.hpp"
 #include <boost/asio.hpp>
+#include <boost/asio/coroutine.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <memory>
+#include <vector>
 namespace http {
 namespace server {
 
 /// Represents a single connection from a client.
+///
+/// The whole lifecycle (handshake, read, parse, handle, write, sendfile, keep-alive) is one stackless
+/// coroutine in operator(). Derived classes only provide the stream operations, so plain and TLS
+/// connections share it. Every operation completes through an io_handler, whose memory comes from the
+/// connection itself, so a request on a persistent connection does not allocate handlers.
 class connection : public virtual boost::enable_shared_from_this<connection>, private boost::noncopyable {
     public:
-    /// Construct a connection with the given io_service.
-    explicit connection(boost::asio::io_service &io_service, request_handler &handler);
+    /// Construct a connection running on the given worker's io_service.
+    explicit connection(worker &w, request_handler &handler, const server_options &options);
 
     virtual ~connection();
 
@@ -37,30 +49,161 @@ class connection : public virtual boost::enable_shared_from_this<connection>, pr
     virtual boost::asio::ip::tcp::socket &socket();
 
     /// Start the first asynchronous operation for the connection.
-    virtual void start();
+    void start();
+
+    /// Close the socket and reset the connection to its freshly constructed state, keeping the capacity of
+    /// its buffers, so that it can be used for another accept.
+    virtual void recycle();
+
+    /// Resume the connection's coroutine with the result of the last operation.
+    void operator()(boost::system::error_code ec = boost::system::error_code(), std::size_t bytes_transferred = 0);
 
     protected:
-    virtual void start_reading(const boost::system::error_code &error = {});
+    /// Completion handler of every asynchronous operation of the connection. It keeps the connection alive
+    /// and resumes its coroutine.
+    class io_handler {
+        public:
+        typedef handler_allocator<io_handler> allocator_type;
+
+        explicit io_handler(boost::shared_ptr<connection> self) : self_(std::move(self)) {}
+
+        void operator()(boost::system::error_code ec = boost::system::error_code(), std::size_t n = 0) const {
+            (*self_)(ec, n);
+        }
+
+        allocator_type get_allocator() const noexcept { return allocator_type(memory()); }
+
+        friend void *asio_handler_allocate(std::size_t size, io_handler *h) { return h->memory().allocate(size); }
+
+        friend void asio_handler_deallocate(void *pointer, std::size_t, io_handler *h) {
+            h->memory().deallocate(pointer);
+        }
+
+        private:
+        handler_memory &memory() const { return self_->handler_memory_; }
+
+        boost::shared_ptr<connection> self_;
+    };
 
+    /// Whether the stream needs a handshake before the first read.
+    virtual bool needs_handshake() const { return false; }
+
+    virtual void async_handshake(io_handler handler);
+
+    /// Hand the connection over to the protocol negotiated during the handshake, if it is not HTTP/1.1. Returns
+    /// true if it did, in which case the coroutine ends and the protocol's own operations keep the connection
+    /// alive.
+    virtual bool upgrade() { return false; }
+
+    virtual void async_read_some(boost::asio::mutable_buffers_1 buffer, io_handler handler);
+
+    virtual void async_write(const_buffers_view buffers, io_handler handler);
+
+    /// Hand the complete request to the request handler to fill in rep. Returns false if the reply will be
+    /// completed later, in which case the handler is invoked once it is.
+    virtual bool handle_request(reply &rep, io_handler handler);
+
+    /// Send the file of the reply, if any. Returns false if there is nothing to send.
+    virtual bool async_sendfile(io_handler handler);
+
+    /// Arm the timeout for the next request, which closes the connection if no request arrives in time.
     void keep_alive();
 
-    void keep_alive_if_needed();
+    /// Arm the timeout for the rest of the request line and headers, which must arrive in time regardless
+    /// of how they are split.
+    void await_headers();
+
+    void handle_timeout();
+
+    /// Send a 408 Request Timeout reply to a client whose headers did not arrive in time, then close the
+    /// connection.
+    void reply_timed_out();
+
+    /// The status of the reply to a request the parser rejected.
+    reply::status_type parse_error_status() const;
+
+    bool wants_keep_alive(reply &rep);
+
+    /// Have the connection closed once rep is sent.
+    void close_after(reply &rep);
+
+    /// Make room for reading at least size bytes after read_end_. What is kept of buffer_, from head_begin_ on, is
+    /// moved to its start, or to a larger buffer if it is too full, and the views of request_ follow.
+    void make_room(std::size_t size);
+
+    /// The part of buffer_ after read_end_, where the next read goes.
+    boost::asio::mutable_buffers_1 free_buffer() {
+        return boost::asio::buffer(&buffer_[read_end_], buffer_.size() - read_end_);
+    }
+
+    /// Start a new request at read_begin_.
+    void next_request();
+
+    /// Continue parsing the bytes of buffer_ that have not been parsed yet. Returns indeterminate once they are
+    /// all consumed without completing a request.
+    boost::tribool parse_buffered();
+
+    /// Get the next piece of a streamed reply from its producer and frame it in write_buffers_.
+    void next_chunk();
+
+    /// Start the reply to the next request of the batch.
+    void next_reply();
+
+    /// Forget the replies of the batch that have been written ahead of the current one, which becomes the first.
+    void restart_batch();
+
+    reply &current_reply() { return replies_[batch_size_ - 1]; }
+
+    /// Prepare to read the body of the complete request in request_, starting with what has already been read.
+    /// Returns false if the request must not be handled, with its reply in current_reply().
+    bool begin_body();
+
+    /// Read more of the body.
+    void async_read_body(io_handler handler);
+
+    /// Take in the bytes read by async_read_body. Returns false like begin_body.
+    bool body_read(std::size_t bytes_transferred);
+
+    /// Decode the chunked body in the unparsed part of buffer_. Returns false like begin_body.
+    bool parse_chunked();
 
-    void handle_sendfile_done(const boost::system::error_code &, std::size_t);
+    /// Hand a piece of the body to its file or body handler, or append it to request_.body.
+    void body_data(const char *data, std::size_t size);
 
-    void drain_body(boost::system::error_code &ec);
+    /// Check that the body read so far can be handled. Returns false like begin_body.
+    bool check_body();
 
-    void drain_body_if_needed();
+    /// Whether the stream is the TCP socket itself, so that request bodies can be spliced from it.
+    virtual bool can_splice() const { return true; }
 
-    virtual void sync_read(char *where, std::size_t bytes, boost::system::error_code &ec);
+    /// Open the pipe bodies are spliced through, unless it is open already. Returns false if it cannot be used.
+    bool open_splice_pipe();
 
-    /// Handle completion of a read operation.
-    virtual void handle_read(const boost::system::error_code &e, std::size_t bytes_transferred);
+    /// Splice the body bytes the socket has to the body file, without waiting for more.
+    void splice_body();
 
-    /// Handle completion of a write operation.
-    virtual void handle_write(const boost::system::error_code &e);
+    /// Move bytes already read, such as the start of the body read with the headers, to the body file.
+    bool splice_buffered(const char *data, std::size_t size);
 
-    void handle_idle_timer(const boost::system::error_code &e);
+    /// Move size bytes from the pipe to the body file.
+    bool drain_splice_pipe(std::size_t size);
+
+    void close_splice_pipe();
+
+    /// Hold back partial frames on the socket (TCP_CORK) so that the headers and the start of a file go out
+    /// together. Uncorking flushes what is left.
+    void cork(bool on);
+
+    /// Stop counting the connection in the worker's and the pool's active connections.
+    void end_connection();
+
+    /// Account for a response in the worker's load from the moment its request is complete...
+    void begin_response();
+
+    /// ...until it has been fully handed to the socket.
+    void end_response();
+
+    io_handler make_handler() { return io_handler(shared_from_this()); }
 
     private:
     /// Socket for the connection.
@@ -70,8 +213,15 @@ class connection : public virtual boost::enable_shared_from_this<connection>, pr
     /// The handler used to process the incoming request.
     request_handler &request_handler_;
 
-    /// Buffer for incoming data.
-    boost::array<char, 8192> buffer_;
+    /// Buffer for incoming data. It grows when a request line and headers do not fit.
+    std::vector<char> buffer_;
+
+    /// The part of buffer_ that has been read but not parsed yet: the rest of a pipelined batch.
+    std::size_t read_begin_, read_end_;
+
+    /// The part of buffer_ holding the request line and headers of request_, which its views point into. It is
+    /// kept until the request is answered.
+    std::size_t head_begin_, head_end_;
 
     /// The incoming request.
     request request_;
@@ -79,16 +229,92 @@ class connection : public virtual boost::enable_shared_from_this<connection>, pr
     /// The parser for the incoming request.
     request_parser request_parser_;
 
-    /// The reply to be sent back to the client.
-    reply reply_;
+    /// The result of parsing the data read so far.
+    boost::tribool parse_result_;
+
+    /// The replies of the current batch of pipelined requests, in request order. Kept with their capacity
+    /// between batches.
+    std::vector<reply> replies_;
+
+    std::size_t batch_size_;
+
+    /// The buffers of the reply being written.
+    std::vector<boost::asio::const_buffer> write_buffers_;
 
     sendfile_op sendfile_;
 
+    /// Whether the producer of the streamed reply being sent has more to send, and whether its pieces are sent as
+    /// chunks rather than delimited by the end of the connection.
+    bool streaming_, chunked_;
+
+    /// The size line of the chunk being written.
+    std::string chunk_size_;
+
     boost::asio::io_service &io_service_;
 
-    std::unique_ptr<boost::asio::deadline_timer> timer_;
+    worker &worker_;
+
+    const server_options &options_;
+
+    /// Whether the connection is counted in the worker's active connections and queued handlers.
+    bool started_, responding_;
+
+    /// Whether the socket is corked for the current response.
+    bool corked_;
+
+    /// The length of the body of the request being read, what is left of it, and the handler it goes to instead
+    /// of request_.body, if any.
+    std::size_t body_length_, body_remaining_;
+    const user_handler::body_handler *body_handler_;
+
+    /// Whether the body is sent with Transfer-Encoding: chunked, whose length is only known at its end, and
+    /// whether it has not been read completely yet.
+    bool body_chunked_, reading_body_;
+
+    /// Whether the body is spliced from the socket to its file, and whether storing it failed.
+    bool body_splice_, body_failed_;
+
+    /// Whether the body is left unread because the reply does not need it, and whether the client waits for
+    /// 100 Continue before sending it.
+    bool body_skipped_, send_continue_;
+
+    /// The file the body is stored in, if its user handler asked for one.
+    std::unique_ptr<file_descriptor> body_file_;
+
+    /// The read and write ends of the pipe bodies are spliced through, kept for the requests of the connection.
+    int splice_pipe_[2];
+
+    chunked_parser chunked_parser_;
+
+    /// The state of the connection's coroutine.
+    boost::asio::coroutine coroutine_;
+
+    /// Memory for the operations of the connection.
+    handler_memory handler_memory_;
+
+    /// The keep-alive or header read timeout, on the worker's timing wheel.
+    timing_wheel::entry timeout_;
+
+    /// Whether timeout_ is the header read timeout, and whether it expired while a request was being received.
+    bool awaiting_headers_, header_timed_out_;
+
+    /// Whether the last reply of the connection is being sent, after which the connection is closed whatever
+    /// happens.
+    bool closing_;
 
     static constexpr int keep_alive_seconds = 15;
+
+    /// How long every read of a request body may take.
+    static constexpr int body_timeout_seconds = 15;
+
+    /// The least a read of a request body kept in memory asks for.
+    static constexpr std::size_t body_read_size = 65536;
+
+    /// The size buffer_ starts with, and returns to when the connection is recycled.
+    static constexpr std::size_t buffer_size = 8192;
+
+    /// The least a read into buffer_ asks for.
+    static constexpr std::size_t min_read_size = 2048;
 };
 
 typedef boost::shared_ptr<connection> connection_ptr;
@@ -0,0 +1,92 @@
+//
+// connection_pool.cpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "connection_pool.hpp"
+#include "connection.hpp"
+#include "ssl_connection.hpp"
+#include "worker.hpp"
+
+http::server::connection_pool::connection_pool(std::size_t capacity) : capacity_(capacity), shut_down_(false) {}
+
+http::server::connection_pool::~connection_pool() { shutdown(); }
+
+http::server::connection_ptr
+http::server::connection_pool::make_connection(http::server::worker &w, http::server::request_handler &handler,
+                                               const http::server::server_options &options) {
+    auto c = take(connections_);
+    if (!c)
+        c = new connection(w, handler, options);
+    return connection_ptr(c, [this, &w](connection *c) { this->hand_back(w, connections_, c); });
+}
+
+http::server::ssl_connection_ptr
+http::server::connection_pool::make_ssl_connection(http::server::worker &w, boost::asio::ssl::context &context,
+                                                   http::server::request_handler &handler,
+                                                   const http::server::server_options &options) {
+    auto c = take(ssl_connections_);
+    if (!c)
+        c = new ssl_connection(w, context, handler, options);
+    return ssl_connection_ptr(c, [this, &w](ssl_connection *c) { this->hand_back(w, ssl_connections_, c); });
+}
+
+void http::server::connection_pool::shutdown() {
+    std::vector<connection *> connections;
+    std::vector<ssl_connection *> ssl_connections;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shut_down_ = true;
+        connections.swap(connections_);
+        ssl_connections.swap(ssl_connections_);
+    }
+    for (auto c : connections)
+        delete c;
+    for (auto c : ssl_connections)
+        delete c;
+}
+
+template <typename T> T *http::server::connection_pool::take(std::vector<T *> &idle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle.empty())
+        return nullptr;
+    auto c = idle.back();
+    idle.pop_back();
+    return c;
+}
+
+template <typename T>
+void http::server::connection_pool::hand_back(http::server::worker &w, std::vector<T *> &idle, T *c) {
+    {
+        // Once shut down, the io_service may be gone or being destroyed along with the handlers holding c.
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (shut_down_) {
+            delete c;
+            return;
+        }
+    }
+    // Resetting the connection cancels its timeout on the worker's timing wheel and closes its socket, which
+    // must happen on the worker's thread. Runs right away when the last reference is dropped there.
+    w.io_service.dispatch([this, &idle, c]() { this->release(idle, c); });
+}
+
+template <typename T> void http::server::connection_pool::release(std::vector<T *> &idle, T *c) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!shut_down_ && idle.size() < capacity_) {
+        // Reset outside the lock: it closes the socket and, for TLS, creates a new stream.
+        lock.unlock();
+        c->recycle();
+        lock.lock();
+        if (!shut_down_) {
+            idle.push_back(c);
+            return;
+        }
+    }
+    lock.unlock();
+    delete c;
+}
@@ -0,0 +1,72 @@
+//
+// connection_pool.hpp
+// ~~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef CONNECTION_POOL_HPP
+#define CONNECTION_POOL_HPP
+
+#include <boost/asio/ssl/context.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace http {
+namespace server {
+
+class connection;
+class ssl_connection;
+class request_handler;
+struct server_options;
+struct worker;
+
+/// Recycles the connection objects of one worker. A finished connection is reset and kept, so that the next
+/// accept reuses its buffers and string capacities instead of allocating a new object. Pooled connections
+/// keep the request handler, SSL context and options they were created with, so a pool must only serve one
+/// server.
+///
+/// The last reference to a connection may be dropped on any thread, for example by a blocking handler or
+/// the completion of an asynchronous one. The connection is then handed back on the thread of its worker, and
+/// reset there. The idle objects may be taken by the listener of another worker, hence the mutex.
+class connection_pool : private boost::noncopyable {
+    public:
+    /// Construct a pool keeping at most capacity idle objects of each kind.
+    explicit connection_pool(std::size_t capacity = 512);
+
+    ~connection_pool();
+
+    boost::shared_ptr<connection> make_connection(worker &w, request_handler &handler,
+                                                  const server_options &options);
+
+    boost::shared_ptr<ssl_connection> make_ssl_connection(worker &w, boost::asio::ssl::context &context,
+                                                          request_handler &handler, const server_options &options);
+
+    /// Delete the idle objects and stop keeping released ones. Must be called while the io_service of the
+    /// connections still exists.
+    void shutdown();
+
+    private:
+    template <typename T> T *take(std::vector<T *> &idle);
+
+    /// Called when the last reference to c is dropped, on any thread: release it on its worker's io_service.
+    template <typename T> void hand_back(worker &w, std::vector<T *> &idle, T *c);
+
+    template <typename T> void release(std::vector<T *> &idle, T *c);
+
+    std::mutex mutex_;
+    const std::size_t capacity_;
+    bool shut_down_;
+    std::vector<connection *> connections_;
+    std::vector<ssl_connection *> ssl_connections_;
+};
+}
+}
+
+#endif // CONNECTION_POOL_HPP
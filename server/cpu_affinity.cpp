@@ -0,0 +1,157 @@
+//
+// cpu_affinity.cpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "cpu_affinity.hpp"
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <pthread.h>
+#include <regex>
+#include <sched.h>
+#include <thread>
+
+namespace {
+const std::string sys_cpu = "/sys/devices/system/cpu";
+const std::string sys_node = "/sys/devices/system/node";
+
+std::string read_first_line(const std::string &path) {
+    std::ifstream f(path);
+    std::string line;
+    std::getline(f, line);
+    return line;
+}
+
+std::vector<int> intersect(const std::vector<int> &sorted_a, const std::vector<int> &sorted_b) {
+    std::vector<int> out;
+    std::set_intersection(sorted_a.begin(), sorted_a.end(), sorted_b.begin(), sorted_b.end(),
+                          std::back_inserter(out));
+    return out;
+}
+}
+
+std::vector<int> http::server::cpu_affinity::parse_cpu_list(const std::string &list) {
+    std::vector<int> cpus;
+    std::size_t pos = 0;
+    while (pos < list.size()) {
+        auto comma = list.find(',', pos);
+        if (comma == std::string::npos)
+            comma = list.size();
+        auto range = list.substr(pos, comma - pos);
+        pos = comma + 1;
+        if (range.empty())
+            continue;
+        try {
+            auto dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu)
+                cpus.push_back(cpu);
+        } catch (const std::logic_error &) {
+            return {};
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+std::vector<int> http::server::cpu_affinity::online_cpus() {
+    auto cpus = parse_cpu_list(read_first_line(sys_cpu + "/online"));
+    if (cpus.empty()) {
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<int> http::server::cpu_affinity::physical_cores() {
+    std::vector<int> cores;
+    for (int cpu : online_cpus()) {
+        auto siblings = parse_cpu_list(
+            read_first_line(sys_cpu + "/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list"));
+        // Keep a CPU only if it is the lowest numbered sibling of its core.
+        if (siblings.empty() || siblings.front() == cpu)
+            cores.push_back(cpu);
+    }
+    return cores;
+}
+
+std::vector<std::vector<int>> http::server::cpu_affinity::numa_nodes() {
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+    boost::system::error_code ec;
+    static const std::regex node_dir("node([0-9]+)");
+    for (boost::filesystem::directory_iterator it(sys_node, ec), end; !ec && it != end; it.increment(ec)) {
+        std::smatch match;
+        auto name = it->path().filename().string();
+        if (std::regex_match(name, match, node_dir)) {
+            auto cpus = parse_cpu_list(read_first_line(it->path().string() + "/cpulist"));
+            if (!cpus.empty())
+                nodes.emplace_back(std::stoi(match[1]), cpus);
+        }
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    std::vector<std::vector<int>> result;
+    for (auto &node : nodes)
+        result.push_back(std::move(node.second));
+    if (result.empty())
+        result.push_back(online_cpus());
+    return result;
+}
+
+std::vector<int> http::server::cpu_affinity::assign(const http::server::affinity_policy &policy,
+                                                    std::size_t thread_count) {
+    std::vector<int> order;
+    switch (policy.kind) {
+    case affinity_policy::type::none:
+        break;
+    case affinity_policy::type::explicit_cores:
+        order = policy.cores;
+        break;
+    case affinity_policy::type::physical_cores:
+        order = physical_cores();
+        break;
+    case affinity_policy::type::numa_nodes: {
+        // Interleave the physical cores of every node so that consecutive threads land on different nodes.
+        auto cores = physical_cores();
+        std::vector<std::vector<int>> per_node;
+        for (const auto &node : numa_nodes())
+            per_node.push_back(intersect(node, cores));
+        for (std::size_t i = 0; order.size() < cores.size(); ++i) {
+            bool any = false;
+            for (const auto &node : per_node) {
+                if (i < node.size()) {
+                    order.push_back(node[i]);
+                    any = true;
+                }
+            }
+            if (!any)
+                break;
+        }
+        break;
+    }
+    }
+
+    std::vector<int> cpus(thread_count, -1);
+    if (!order.empty()) {
+        for (std::size_t i = 0; i < thread_count; ++i)
+            cpus[i] = order[i % order.size()];
+    }
+    return cpus;
+}
+
+bool http::server::cpu_affinity::pin_current_thread(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
@@ -0,0 +1,60 @@
+//
+// cpu_affinity.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef CPU_AFFINITY_HPP
+#define CPU_AFFINITY_HPP
+
+#include <string>
+#include <vector>
+
+namespace http {
+namespace server {
+
+/// Describes how the threads of the io_service pool are pinned to CPUs.
+struct affinity_policy {
+    enum class type {
+        /// Threads are left to the scheduler.
+        none,
+        /// Threads are pinned to the CPUs in cores, in order, wrapping around if there are more threads.
+        explicit_cores,
+        /// Every thread gets its own physical core. Hyperthread siblings are left unused.
+        physical_cores,
+        /// Like physical_cores, but consecutive threads are spread over the NUMA nodes.
+        numa_nodes
+    } kind = type::none;
+
+    /// The CPUs used by type::explicit_cores.
+    std::vector<int> cores;
+};
+
+namespace cpu_affinity {
+
+/// Returns the CPU each of thread_count threads should be pinned to, or -1 where a thread is not pinned.
+std::vector<int> assign(const affinity_policy &policy, std::size_t thread_count);
+
+/// Pins the calling thread to the given CPU. Returns false if the CPU could not be set.
+bool pin_current_thread(int cpu);
+
+/// The online CPUs of the machine.
+std::vector<int> online_cpus();
+
+/// The first online CPU of every physical core.
+std::vector<int> physical_cores();
+
+/// The online CPUs of every NUMA node. Machines without NUMA information report a single node.
+std::vector<std::vector<int>> numa_nodes();
+
+/// Parses a kernel CPU list such as "0-3,8,10-11".
+std::vector<int> parse_cpu_list(const std::string &list);
+}
+}
+}
+
+#endif // CPU_AFFINITY_HPP
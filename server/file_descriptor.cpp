@@ -9,15 +9,29 @@
 //
 
 #include "file_descriptor.hpp"
+#include <cerrno>
 #include <fcntl.h>
 #include <string>
 #include <system_error>
 #include <unistd.h>
 
-http::server::file_descriptor::file_descriptor(const std::string &path, int mode)
-    : value(::open(path.c_str(), mode)), path(path) {
+http::server::file_descriptor::file_descriptor(const std::string &path, int mode, int permissions)
+    : value(::open(path.c_str(), mode, permissions)), path(path) {
     if (!good())
         throw std::system_error(std::error_code(errno, std::system_category()));
 }
 
 http::server::file_descriptor::~file_descriptor() { ::close(value); }
+
+bool http::server::file_descriptor::write(const char *data, std::size_t size) {
+    while (size) {
+        auto n = ::write(value, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
@@ -10,6 +10,7 @@
 
 #ifndef FILE_DESC
 #define FILE_DESC
+#include <cstddef>
 #include <string>
 
 namespace http {
@@ -19,12 +20,16 @@ struct file_descriptor {
     int value;
     std::string path;
     file_descriptor() = default;
-    file_descriptor(const std::string &path, int mode);
+    /// Open path with the given open() flags. The permissions apply to a file created by O_CREAT.
+    file_descriptor(const std::string &path, int mode, int permissions = 0644);
     ~file_descriptor();
     file_descriptor(const file_descriptor &) = delete;
     file_descriptor &operator=(const file_descriptor &) = delete;
 
     inline bool good() const { return value != -1; }
+
+    /// Write all of data, retrying partial and interrupted writes. Returns false if writing failed.
+    bool write(const char *data, std::size_t size);
 };
 }
 }
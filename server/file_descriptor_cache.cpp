@@ -9,24 +9,16 @@
 //
 
 #include "file_descriptor_cache.hpp"
-#include <mutex>
-#include <system_error>
-#include <unordered_map>
 
 std::shared_ptr<http::server::file_descriptor> http::server::file_descriptor_cache::get(const std::string &path,
                                                                                         int mode) {
     using namespace std;
-    static unordered_map<string, weak_ptr<file_descriptor>> cache;
-    static mutex m;
-
-    lock_guard<mutex> hold(m);
-    auto sp = cache[path].lock();
-    if (!sp) {
-        try {
-            cache[path] = sp = make_shared<file_descriptor>(path, mode);
-        } catch (const std::system_error &) {
-            throw;
-        }
-    }
+    unique_lock<mutex> hold(mutex_, defer_lock);
+    if (synchronized_)
+        hold.lock();
+    auto &entry = cache_[path];
+    auto sp = entry.lock();
+    if (!sp)
+        entry = sp = make_shared<file_descriptor>(path, mode);
     return sp;
 }
@@ -11,13 +11,26 @@
 #ifndef FILE_DESC_CACHE
 #define FILE_DESC_CACHE
 #include "file_descriptor.hpp"
+#include <boost/noncopyable.hpp>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 namespace http {
 namespace server {
 
-struct file_descriptor_cache {
-    static std::shared_ptr<file_descriptor> get(const std::string &path, int mode);
+/// Open files shared by the replies that send them. A cache used by a single thread can skip the lock.
+class file_descriptor_cache : private boost::noncopyable {
+    public:
+    explicit file_descriptor_cache(bool synchronized = true) : synchronized_(synchronized) {}
+
+    std::shared_ptr<file_descriptor> get(const std::string &path, int mode);
+
+    private:
+    std::unordered_map<std::string, std::weak_ptr<file_descriptor>> cache_;
+    std::mutex mutex_;
+    const bool synchronized_;
 };
 }
 }
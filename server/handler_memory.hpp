@@ -0,0 +1,74 @@
+//
+// handler_memory.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+// Copyright (c) 2003-2015 Christopher M. Kohlhoff (chris at kohlhoff dot com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HANDLER_MEMORY_HPP
+#define HANDLER_MEMORY_HPP
+
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace http {
+namespace server {
+
+/// Storage for the memory of an object's asynchronous operations. An object that has at most one
+/// operation in flight at a time never touches the heap; a second concurrent operation falls back to it.
+class handler_memory : private boost::noncopyable {
+    public:
+    handler_memory() : in_use_(false) {}
+
+    void *allocate(std::size_t size) {
+        if (!in_use_ && size <= sizeof(storage_)) {
+            in_use_ = true;
+            return &storage_;
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void *pointer) {
+        if (pointer == &storage_)
+            in_use_ = false;
+        else
+            ::operator delete(pointer);
+    }
+
+    private:
+    std::aligned_storage<512>::type storage_;
+    bool in_use_;
+};
+
+/// The allocator to associate with a completion handler so that Asio takes its memory from a handler_memory.
+template <typename T> class handler_allocator {
+    public:
+    typedef T value_type;
+
+    explicit handler_allocator(handler_memory &memory) : memory_(memory) {}
+
+    template <typename U> handler_allocator(const handler_allocator<U> &other) noexcept : memory_(other.memory_) {}
+
+    bool operator==(const handler_allocator &other) const noexcept { return &memory_ == &other.memory_; }
+
+    bool operator!=(const handler_allocator &other) const noexcept { return &memory_ != &other.memory_; }
+
+    T *allocate(std::size_t n) const { return static_cast<T *>(memory_.allocate(sizeof(T) * n)); }
+
+    void deallocate(T *pointer, std::size_t) const { memory_.deallocate(pointer); }
+
+    private:
+    template <typename> friend class handler_allocator;
+
+    handler_memory &memory_;
+};
+}
+}
+
+#endif // HANDLER_MEMORY_HPP
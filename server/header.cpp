@@ -10,4 +10,73 @@
 //
 
 #include "header.hpp"
+#include "string_utils.hpp"
+#include <initializer_list>
+
+namespace {
+/// The names of the known headers, in the order of the enum.
+const char *const known_header_names[] = {"Accept",
+                                          "Accept-Encoding",
+                                          "Accept-Language",
+                                          "Authorization",
+                                          "Cache-Control",
+                                          "Connection",
+                                          "Content-Length",
+                                          "Content-Type",
+                                          "Cookie",
+                                          "Expect",
+                                          "Host",
+                                          "If-Modified-Since",
+                                          "If-None-Match",
+                                          "Range",
+                                          "Referer",
+                                          "Transfer-Encoding",
+                                          "Upgrade",
+                                          "User-Agent"};
+
+static_assert(sizeof(known_header_names) / sizeof(known_header_names[0]) == http::server::known_header_count,
+              "every known header needs a name");
+
+http::server::known_header match(boost::string_view name,
+                                 std::initializer_list<http::server::known_header> candidates) {
+    for (auto h : candidates) {
+        if (http::server::iequals(name, http::server::known_header_name(h)))
+            return h;
+    }
+    return http::server::known_header::unknown;
+}
+}
+
 http::server::header::header(const std::string &name, const std::string &value) : name(name), value(value) {}
+
+http::server::known_header http::server::find_known_header(boost::string_view name) {
+    // The length leaves at most three candidates.
+    switch (name.size()) {
+    case 4:
+        return match(name, {known_header::host});
+    case 5:
+        return match(name, {known_header::range});
+    case 6:
+        return match(name, {known_header::accept, known_header::cookie, known_header::expect});
+    case 7:
+        return match(name, {known_header::referer, known_header::upgrade});
+    case 10:
+        return match(name, {known_header::connection, known_header::user_agent});
+    case 12:
+        return match(name, {known_header::content_type});
+    case 13:
+        return match(name, {known_header::authorization, known_header::cache_control, known_header::if_none_match});
+    case 14:
+        return match(name, {known_header::content_length});
+    case 15:
+        return match(name, {known_header::accept_encoding, known_header::accept_language});
+    case 17:
+        return match(name, {known_header::if_modified_since, known_header::transfer_encoding});
+    default:
+        return known_header::unknown;
+    }
+}
+
+const char *http::server::known_header_name(http::server::known_header h) {
+    return known_header_names[static_cast<std::size_t>(h)];
+}
@@ -12,6 +12,9 @@
 #ifndef HTTP_SERVER3_HEADER_HPP
 #define HTTP_SERVER3_HEADER_HPP
 
+#include <boost/utility/string_view.hpp>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 namespace http {
@@ -24,6 +27,38 @@ struct header {
     header(const std::string &name, const std::string &value);
 };
 
+/// The header fields the server and most handlers look for. Requests index them as they are parsed, so that
+/// looking one up is a single slot access.
+enum class known_header : std::uint8_t {
+    accept,
+    accept_encoding,
+    accept_language,
+    authorization,
+    cache_control,
+    connection,
+    content_length,
+    content_type,
+    cookie,
+    expect,
+    host,
+    if_modified_since,
+    if_none_match,
+    range,
+    referer,
+    transfer_encoding,
+    upgrade,
+    user_agent,
+    unknown
+};
+
+constexpr std::size_t known_header_count = static_cast<std::size_t>(known_header::unknown);
+
+/// The known header with the given name, compared case-insensitively, or known_header::unknown.
+known_header find_known_header(boost::string_view name);
+
+/// The name of a known header, in its usual case.
+const char *known_header_name(known_header h);
+
 } // namespace server3
 } // namespace http
 
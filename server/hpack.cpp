@@ -0,0 +1,328 @@
+//
+// hpack.cpp
+// ~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "hpack.hpp"
+#include <array>
+#include <strings.h>
+
+namespace {
+/// The static table of RFC 7541, Appendix A. Index 0 is unused.
+const http::server::header static_table[] = {
+    {"", ""},
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+constexpr std::size_t static_table_size = sizeof(static_table) / sizeof(static_table[0]) - 1;
+
+/// The length in bits of the Huffman code of every symbol, RFC 7541 Appendix B. The code is canonical: codes
+/// of the same length are consecutive and ordered by symbol, so the lengths are enough to rebuild it.
+const unsigned char huffman_code_lengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28, //
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28, //
+    6,  10, 10, 12, 13, 6,  8,  11, 10, 10, 8,  11, 8,  6,  6,  6,  //
+    5,  5,  5,  6,  6,  6,  6,  6,  6,  6,  7,  8,  15, 6,  12, 10, //
+    13, 6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  //
+    7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8,  13, 19, 13, 14, 6,  //
+    15, 5,  6,  5,  6,  5,  6,  6,  6,  5,  7,  7,  6,  6,  6,  5,  //
+    6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7,  15, 11, 14, 13, 28, //
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23, //
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24, //
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23, //
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23, //
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25, //
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27, //
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23, //
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26, //
+    30};
+
+constexpr unsigned huffman_eos = 256;
+constexpr unsigned huffman_max_length = 30;
+
+/// The canonical Huffman code in the form a decoder needs: for every length, the first code of that length, how
+/// many codes have it, and where their symbols start in the symbols sorted by code.
+struct huffman_code {
+    std::array<std::uint32_t, huffman_max_length + 1> first{}, count{}, offset{};
+    std::array<std::uint16_t, 257> symbols{};
+
+    huffman_code() {
+        for (auto length : huffman_code_lengths)
+            ++count[length];
+        std::uint32_t code = 0, position = 0;
+        for (unsigned length = 1; length <= huffman_max_length; ++length) {
+            first[length] = code;
+            offset[length] = position;
+            for (unsigned symbol = 0; symbol < 257; ++symbol) {
+                if (huffman_code_lengths[symbol] == length)
+                    symbols[position++] = symbol;
+            }
+            code = (code + count[length]) << 1;
+        }
+    }
+
+    /// Decode the Huffman coded string [p, end) and append it to out.
+    bool decode(const unsigned char *p, const unsigned char *end, std::string &out) const {
+        std::uint32_t code = 0;
+        unsigned length = 0;
+        for (; p != end; ++p) {
+            for (int bit = 7; bit >= 0; --bit) {
+                code = (code << 1) | ((*p >> bit) & 1);
+                ++length;
+                if (code - first[length] < count[length]) {
+                    auto symbol = symbols[offset[length] + code - first[length]];
+                    if (symbol == huffman_eos)
+                        return false;
+                    out += static_cast<char>(symbol);
+                    code = 0;
+                    length = 0;
+                } else if (length == huffman_max_length) {
+                    return false;
+                }
+            }
+        }
+        // The padding is the shortest prefix of EOS that completes the last byte: at most 7 bits, all ones.
+        return length < 8 && code == (1u << length) - 1;
+    }
+};
+
+const huffman_code huffman;
+
+bool decode_integer(const unsigned char *&p, const unsigned char *end, unsigned prefix_bits, std::uint64_t &value) {
+    if (p == end)
+        return false;
+    const unsigned mask = (1u << prefix_bits) - 1;
+    value = *p++ & mask;
+    if (value < mask)
+        return true;
+    for (unsigned shift = 0;; shift += 7) {
+        // Nothing a header block needs takes more than 56 bits.
+        if (p == end || shift > 56)
+            return false;
+        auto byte = *p++;
+        value += std::uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+}
+
+bool decode_string(const unsigned char *&p, const unsigned char *end, std::string &out) {
+    if (p == end)
+        return false;
+    bool huffman_coded = *p & 0x80;
+    std::uint64_t length;
+    if (!decode_integer(p, end, 7, length) || length > std::uint64_t(end - p))
+        return false;
+    out.clear();
+    if (huffman_coded) {
+        if (!huffman.decode(p, p + length, out))
+            return false;
+    } else {
+        out.assign(reinterpret_cast<const char *>(p), length);
+    }
+    p += length;
+    return true;
+}
+
+void encode_integer(std::uint64_t value, unsigned prefix_bits, unsigned char first_byte, std::string &out) {
+    const unsigned mask = (1u << prefix_bits) - 1;
+    if (value < mask) {
+        out += static_cast<char>(first_byte | value);
+        return;
+    }
+    out += static_cast<char>(first_byte | mask);
+    value -= mask;
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+/// The size of a field in the dynamic table and in a header list.
+std::size_t entry_size(const http::server::header &h) { return h.name.size() + h.value.size() + 32; }
+
+/// The index of the first static table entry with the given name, compared case-insensitively, or 0.
+std::size_t find_static_name(const std::string &name) {
+    for (std::size_t i = 1; i <= static_table_size; ++i) {
+        const auto &candidate = static_table[i].name;
+        if (candidate.size() == name.size() && ::strncasecmp(candidate.data(), name.data(), name.size()) == 0)
+            return i;
+    }
+    return 0;
+}
+}
+
+http::server::hpack::decoder::decoder(std::size_t max_table_size, std::size_t max_list_size)
+    : table_size_(0), max_table_size_(max_table_size), table_size_limit_(max_table_size),
+      max_list_size_(max_list_size) {}
+
+bool http::server::hpack::decoder::decode(const char *begin, const char *end,
+                                          std::vector<http::server::header> &headers) {
+    auto p = reinterpret_cast<const unsigned char *>(begin);
+    auto e = reinterpret_cast<const unsigned char *>(end);
+    std::size_t list_size = 0;
+    while (p != e) {
+        std::uint64_t index;
+        if (*p & 0x80) {
+            // Indexed header field.
+            if (!decode_integer(p, e, 7, index))
+                return false;
+            auto h = lookup(index);
+            if (!h)
+                return false;
+            headers.push_back(*h);
+        } else if ((*p & 0xe0) == 0x20) {
+            // Dynamic table size update.
+            if (!decode_integer(p, e, 5, index) || index > table_size_limit_)
+                return false;
+            max_table_size_ = index;
+            evict(max_table_size_);
+            continue;
+        } else {
+            // Literal header field, with incremental indexing (01), without indexing (0000) or never indexed (0001).
+            bool indexing = (*p & 0xc0) == 0x40;
+            if (!decode_integer(p, e, indexing ? 6 : 4, index))
+                return false;
+            headers.emplace_back();
+            auto &h = headers.back();
+            if (index) {
+                auto name = lookup(index);
+                if (!name)
+                    return false;
+                h.name = name->name;
+            } else if (!decode_string(p, e, h.name)) {
+                return false;
+            }
+            if (!decode_string(p, e, h.value))
+                return false;
+            if (indexing)
+                insert(h);
+        }
+
+        list_size += entry_size(headers.back());
+        if (list_size > max_list_size_)
+            return false;
+    }
+    return true;
+}
+
+const http::server::header *http::server::hpack::decoder::lookup(std::uint64_t index) const {
+    if (index == 0)
+        return nullptr;
+    if (index <= static_table_size)
+        return &static_table[index];
+    index -= static_table_size + 1;
+    return index < table_.size() ? &table_[index] : nullptr;
+}
+
+void http::server::hpack::decoder::insert(const http::server::header &h) {
+    auto size = entry_size(h);
+    if (size > max_table_size_) {
+        // An entry larger than the table empties it and is not added.
+        evict(0);
+        return;
+    }
+    evict(max_table_size_ - size);
+    table_.push_front(h);
+    table_size_ += size;
+}
+
+void http::server::hpack::decoder::evict(std::size_t limit) {
+    while (table_size_ > limit) {
+        table_size_ -= entry_size(table_.back());
+        table_.pop_back();
+    }
+}
+
+void http::server::hpack::encode_status(int status, std::string &out) {
+    auto value = std::to_string(status);
+    for (std::size_t i = 8; i <= 14; ++i) {
+        if (value == static_table[i].value) {
+            encode_integer(i, 7, 0x80, out);
+            return;
+        }
+    }
+    // Literal without indexing, with the name of entry 8.
+    encode_integer(8, 4, 0x00, out);
+    encode_integer(value.size(), 7, 0x00, out);
+    out += value;
+}
+
+void http::server::hpack::encode(const std::string &name, const std::string &value, std::string &out) {
+    if (auto index = find_static_name(name)) {
+        encode_integer(index, 4, 0x00, out);
+    } else {
+        out += '\0';
+        encode_integer(name.size(), 7, 0x00, out);
+        for (auto c : name)
+            out += static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+    }
+    encode_integer(value.size(), 7, 0x00, out);
+    out += value;
+}
@@ -0,0 +1,70 @@
+//
+// hpack.hpp
+// ~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HPACK_HPP
+#define HPACK_HPP
+
+#include "header.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace http {
+namespace server {
+namespace hpack {
+
+/// Decodes the header blocks of one HTTP/2 connection (RFC 7541). The decoder mirrors the dynamic table built
+/// by the peer's encoder, so all the header blocks of a connection must go through the same decoder, in order.
+class decoder {
+    public:
+    /// Construct a decoder whose dynamic table holds at most max_table_size bytes, the value advertised in
+    /// SETTINGS_HEADER_TABLE_SIZE. A block whose fields add up to more than max_list_size bytes, counted as in
+    /// SETTINGS_MAX_HEADER_LIST_SIZE, is rejected.
+    explicit decoder(std::size_t max_table_size = 4096, std::size_t max_list_size = 65536);
+
+    /// Decode a complete header block, appending its fields to headers. Returns false if the block is malformed
+    /// or too large. The dynamic table can no longer be trusted after that, so it is a connection error.
+    bool decode(const char *begin, const char *end, std::vector<header> &headers);
+
+    private:
+    /// Get the field at the given index of the static and dynamic tables.
+    const header *lookup(std::uint64_t index) const;
+
+    void insert(const header &h);
+
+    /// Evict the oldest entries until the table fits in limit bytes.
+    void evict(std::size_t limit);
+
+    /// The dynamic table, newest entry first.
+    std::deque<header> table_;
+
+    /// The size of the dynamic table as defined by RFC 7541, and the limit set by the encoder.
+    std::size_t table_size_, max_table_size_;
+
+    /// The limit the encoder may set.
+    const std::size_t table_size_limit_;
+
+    const std::size_t max_list_size_;
+};
+
+/// Append the representation of a :status pseudo-header to out.
+void encode_status(int status, std::string &out);
+
+/// Append the representation of a header field to out. The name is lowercased, as HTTP/2 requires. Fields are
+/// never added to the peer's dynamic table and are sent without Huffman coding: responses are encoded once and
+/// the table would only cost memory on both sides.
+void encode(const std::string &name, const std::string &value, std::string &out);
+}
+}
+}
+
+#endif // HPACK_HPP
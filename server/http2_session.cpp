@@ -0,0 +1,964 @@
+//
+// http2_session.cpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "http2_session.hpp"
+#include "connection.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <system_error>
+
+namespace {
+const char client_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr std::size_t client_preface_size = sizeof(client_preface) - 1;
+
+constexpr std::uint8_t end_stream_flag = 0x1;
+constexpr std::uint8_t ack_flag = 0x1;
+constexpr std::uint8_t end_headers_flag = 0x4;
+constexpr std::uint8_t padded_flag = 0x8;
+constexpr std::uint8_t priority_flag = 0x20;
+
+constexpr std::uint16_t settings_enable_push = 0x2;
+constexpr std::uint16_t settings_max_concurrent_streams = 0x3;
+constexpr std::uint16_t settings_initial_window_size = 0x4;
+constexpr std::uint16_t settings_max_frame_size = 0x5;
+
+/// The initial flow control window of RFC 7540, until the settings say otherwise.
+constexpr std::int64_t default_window_size = 65535;
+constexpr std::int64_t max_window_size = 0x7fffffff;
+constexpr std::size_t largest_frame_size = 16777215;
+
+std::uint32_t read_uint32(const char *p) {
+    auto u = reinterpret_cast<const unsigned char *>(p);
+    return std::uint32_t(u[0]) << 24 | std::uint32_t(u[1]) << 16 | std::uint32_t(u[2]) << 8 | u[3];
+}
+
+void append_uint32(std::string &out, std::uint32_t value) {
+    out += static_cast<char>(value >> 24);
+    out += static_cast<char>(value >> 16);
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value);
+}
+
+void put_frame_header(char *p, std::size_t length, std::uint8_t type, std::uint8_t flags, std::uint32_t id) {
+    p[0] = static_cast<char>(length >> 16);
+    p[1] = static_cast<char>(length >> 8);
+    p[2] = static_cast<char>(length);
+    p[3] = static_cast<char>(type);
+    p[4] = static_cast<char>(flags);
+    p[5] = static_cast<char>(id >> 24);
+    p[6] = static_cast<char>(id >> 16);
+    p[7] = static_cast<char>(id >> 8);
+    p[8] = static_cast<char>(id);
+}
+
+void append_setting(std::string &out, std::uint16_t id, std::uint32_t value) {
+    out += static_cast<char>(id >> 8);
+    out += static_cast<char>(id);
+    append_uint32(out, value);
+}
+
+/// Header fields that only make sense for HTTP/1.1 connections and are forbidden in HTTP/2, compared
+/// case-insensitively.
+bool is_connection_specific(const std::string &name) {
+    for (auto forbidden : {"connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade"}) {
+        if (::strcasecmp(name.c_str(), forbidden) == 0)
+            return true;
+    }
+    return false;
+}
+
+/// Turn an HTTP/2 field name into the capitalization HTTP/1.1 clients use, "content-length" into
+/// "Content-Length", so that request_handler and the user handlers find the fields they look up.
+void capitalize(std::string &name) {
+    bool word_start = true;
+    for (auto &c : name) {
+        if (word_start && c >= 'a' && c <= 'z')
+            c = c - 'a' + 'A';
+        word_start = c == '-';
+    }
+}
+
+/// The body of a reply: the memory mapping of a file, or the content.
+std::pair<const char *, std::size_t> body_of(const http::server::reply &rep) {
+    if (rep.memory_mapping) {
+        if (!rep.memory_mapping->size())
+            return {nullptr, 0};
+        return {&rep.memory_mapping->at(0), rep.memory_mapping->size()};
+    }
+    return {rep.content.data(), rep.content.size()};
+}
+}
+
+// Passed by reference to std::chrono::seconds, hence defined.
+constexpr int http::server::http2_session::idle_timeout_seconds;
+constexpr int http::server::http2_session::body_timeout_seconds;
+
+void http::server::http2_session::stream::clear() {
+    id = 0;
+    req.clear();
+    rep.clear();
+    fields.clear();
+    receive_window = send_window = 0;
+    sent = 0;
+    received = 0;
+    body_handler = nullptr;
+    body_file.reset();
+    streaming = false;
+    end_of_request = handling = replying = reset = rejected = false;
+}
+
+http::server::http2_session::http2_session(http::server::http2_session::ssl_socket &socket,
+                                           http::server::worker &w, http::server::request_handler &handler,
+                                           const http::server::server_options &options)
+    : socket_(socket), worker_(w), request_handler_(handler), options_(options),
+      in_(2 * (frame_header_size + max_frame_size)), in_begin_(0), in_end_(0), preface_received_(false),
+      write_pending_(false), last_stream_id_(0), header_stream_(0), header_flags_(0),
+      receive_window_(default_window_size), send_window_(default_window_size),
+      initial_send_window_(default_window_size), max_send_frame_(max_frame_size), going_away_(false),
+      closing_(false), read_closed_(false), read_paused_(false),
+      idle_timeout_([this]() { this->handle_idle_timeout(); }),
+      request_timeout_([this]() { this->handle_request_timeout(); }) {}
+
+void http::server::http2_session::start(boost::shared_ptr<http::server::connection> owner) {
+    owner_ = owner;
+
+    // The server's connection preface, followed by the rest of the larger connection window.
+    queue_frame_header(12, settings_frame, 0, 0);
+    append_setting(out_, settings_max_concurrent_streams, max_concurrent_streams);
+    append_setting(out_, settings_initial_window_size, receive_window_size);
+    queue_window_update(0, receive_window_size - default_window_size);
+    receive_window_ = receive_window_size;
+
+    worker_.timers.arm(idle_timeout_, std::chrono::seconds(idle_timeout_seconds));
+    flush();
+    start_read();
+}
+
+void http::server::http2_session::start_read() {
+    if (closing_ || read_closed_)
+        return;
+    auto owner = owner_.lock();
+    socket_.async_read_some(boost::asio::buffer(&in_[in_end_], in_.size() - in_end_),
+                            [this, owner](const boost::system::error_code &ec, std::size_t bytes_transferred) {
+                                this->handle_read(ec, bytes_transferred);
+                            });
+}
+
+void http::server::http2_session::handle_read(const boost::system::error_code &ec, std::size_t bytes_transferred) {
+    if (ec) {
+        read_closed_ = true;
+        flush();
+        return;
+    }
+
+    in_end_ += bytes_transferred;
+    process_frames();
+    if (!awaiting_requests())
+        request_timeout_.cancel();
+
+    // Move the start of the next frame to the front, the buffer always has room for a whole frame after it.
+    if (in_begin_) {
+        std::memmove(&in_[0], &in_[in_begin_], in_end_ - in_begin_);
+        in_end_ -= in_begin_;
+        in_begin_ = 0;
+    }
+
+    flush();
+    // Control frames are answered whether the client reads them or not: stop reading from a client that does
+    // not, rather than queueing its answers without bound, and give it the idle timeout to catch up.
+    if (write_pending_ && out_.size() > write_batch_size) {
+        read_paused_ = true;
+        worker_.timers.arm(idle_timeout_, std::chrono::seconds(idle_timeout_seconds));
+        return;
+    }
+    start_read();
+}
+
+bool http::server::http2_session::process_frames() {
+    if (!preface_received_) {
+        auto available = std::min(in_end_ - in_begin_, client_preface_size);
+        if (std::memcmp(&in_[in_begin_], client_preface, available) != 0) {
+            go_away(protocol_error);
+            return false;
+        }
+        if (available < client_preface_size)
+            return true;
+        in_begin_ += client_preface_size;
+        preface_received_ = true;
+    }
+
+    while (!closing_ && in_end_ - in_begin_ >= frame_header_size) {
+        const char *p = &in_[in_begin_];
+        std::size_t length = read_uint32(p) >> 8;
+        if (length > max_frame_size) {
+            go_away(frame_size_error);
+            return false;
+        }
+        if (in_end_ - in_begin_ < frame_header_size + length)
+            break;
+
+        in_begin_ += frame_header_size + length;
+        if (!handle_frame(p[3], p[4], read_uint32(p + 5) & 0x7fffffff, p + frame_header_size, length))
+            return false;
+    }
+    return !closing_;
+}
+
+bool http::server::http2_session::handle_frame(std::uint8_t type, std::uint8_t flags, std::uint32_t id,
+                                               const char *payload, std::size_t length) {
+    // Nothing may come between the frames of a header block.
+    if (header_stream_ && type != continuation_frame) {
+        go_away(protocol_error);
+        return false;
+    }
+
+    switch (type) {
+    case data_frame:
+        return handle_data(flags, id, payload, length);
+    case headers_frame:
+        return handle_headers(flags, id, payload, length);
+    case priority_frame:
+        // Replies are sent as they complete, so priorities are not used.
+        if (!id) {
+            go_away(protocol_error);
+            return false;
+        }
+        if (length != 5)
+            reset_stream(id, frame_size_error);
+        return true;
+    case rst_stream_frame:
+        return handle_rst_stream(id, payload, length);
+    case settings_frame:
+        return handle_settings(flags, id, payload, length);
+    case ping_frame:
+        if (id || length != 8) {
+            go_away(id ? protocol_error : frame_size_error);
+            return false;
+        }
+        if (!(flags & ack_flag)) {
+            queue_frame_header(8, ping_frame, ack_flag, 0);
+            out_.append(payload, length);
+        }
+        return true;
+    case goaway_frame:
+        if (id) {
+            go_away(protocol_error);
+            return false;
+        }
+        // Finish the open streams, then close.
+        going_away_ = true;
+        return true;
+    case window_update_frame:
+        return handle_window_update(id, payload, length);
+    case continuation_frame:
+        return handle_continuation(flags, id, payload, length);
+    case push_promise_frame:
+        // Clients cannot push.
+        go_away(protocol_error);
+        return false;
+    default:
+        // Unknown frame types must be ignored.
+        return true;
+    }
+}
+
+bool http::server::http2_session::handle_headers(std::uint8_t flags, std::uint32_t id, const char *payload,
+                                                 std::size_t length) {
+    if (!id || id % 2 == 0) {
+        go_away(protocol_error);
+        return false;
+    }
+    if (flags & padded_flag) {
+        std::size_t padding = length ? static_cast<unsigned char>(payload[0]) : 0;
+        if (!length || padding >= length) {
+            go_away(protocol_error);
+            return false;
+        }
+        ++payload;
+        length -= padding + 1;
+    }
+    if (flags & priority_flag) {
+        if (length < 5) {
+            go_away(protocol_error);
+            return false;
+        }
+        payload += 5;
+        length -= 5;
+    }
+
+    header_stream_ = id;
+    header_flags_ = flags;
+    header_block_.assign(payload, length);
+    worker_.timers.arm(request_timeout_, std::chrono::seconds(body_timeout_seconds));
+    return (flags & end_headers_flag) ? end_headers() : true;
+}
+
+bool http::server::http2_session::handle_continuation(std::uint8_t flags, std::uint32_t id, const char *payload,
+                                                      std::size_t length) {
+    if (!header_stream_ || id != header_stream_) {
+        go_away(protocol_error);
+        return false;
+    }
+    if (header_block_.size() + length > max_header_block_size) {
+        go_away(enhance_your_calm);
+        return false;
+    }
+    header_block_.append(payload, length);
+    worker_.timers.arm(request_timeout_, std::chrono::seconds(body_timeout_seconds));
+    return (flags & end_headers_flag) ? end_headers() : true;
+}
+
+bool http::server::http2_session::end_headers() {
+    auto id = header_stream_;
+    header_stream_ = 0;
+
+    // The block must be decoded even if the stream is refused, the dynamic table depends on it.
+    fields_.clear();
+    if (!decoder_.decode(header_block_.data(), header_block_.data() + header_block_.size(), fields_)) {
+        go_away(compression_error);
+        return false;
+    }
+
+    auto it = streams_.find(id);
+    if (it != streams_.end()) {
+        // Trailers, which end the request. Their fields are not passed on.
+        auto &s = *it->second;
+        if (s.reset)
+            return true;
+        if (s.end_of_request || !(header_flags_ & end_stream_flag))
+            abort_stream(s, s.end_of_request ? stream_closed : protocol_error);
+        else
+            dispatch(s);
+        return true;
+    }
+
+    if (id <= last_stream_id_) {
+        go_away(protocol_error);
+        return false;
+    }
+    last_stream_id_ = id;
+    if (going_away_)
+        return true;
+    if (streams_.size() >= max_concurrent_streams) {
+        reset_stream(id, refused_stream);
+        return true;
+    }
+
+    auto s = new_stream();
+    s->id = id;
+    s->receive_window = receive_window_size;
+    s->send_window = initial_send_window_;
+    if (!make_request(*s)) {
+        reset_stream(id, protocol_error);
+        s->clear();
+        idle_streams_.push_back(std::move(s));
+        return true;
+    }
+
+    auto &opened = *s;
+    streams_.emplace(id, std::move(s));
+    idle_timeout_.cancel();
+    if (header_flags_ & end_stream_flag)
+        opened.end_of_request = true;
+    auto status = check_limits(opened.req);
+    if (status != reply::status_type::ok)
+        reject(opened, status);
+    else if (opened.end_of_request)
+        dispatch(opened);
+    else
+        begin_body(opened);
+    return true;
+}
+
+http::server::reply::status_type http::server::http2_session::check_limits(const http::server::request &req) const {
+    // Counted as in HTTP/1.1: the request line is mostly the path, and a field is followed by ": " and CRLF.
+    if (options_.max_request_line_size && req.uri.size() > options_.max_request_line_size)
+        return reply::status_type::uri_too_long;
+    if (options_.max_header_count && req.headers.size() > options_.max_header_count)
+        return reply::status_type::request_header_fields_too_large;
+    std::size_t size = 0;
+    for (const auto &h : req.headers)
+        size += h.name.size() + h.value.size() + 4;
+    if (options_.max_header_size && size > options_.max_header_size)
+        return reply::status_type::request_header_fields_too_large;
+    return reply::status_type::ok;
+}
+
+void http::server::http2_session::begin_body(http::server::http2_session::stream &s) {
+    std::size_t declared = 0;
+    auto content_length = s.req.get_header(known_header::content_length);
+    if (content_length && !parse_size(content_length->value, declared)) {
+        abort_stream(s, protocol_error);
+        return;
+    }
+
+    // Decide whether the body is wanted before the client sends it, if it waits for 100 Continue.
+    auto handler = request_handler_.get_user_handler(s.req);
+    bool expects_continue = false;
+    if (auto expect = s.req.get_header(known_header::expect)) {
+        if (!iequals(expect->value, "100-continue")) {
+            reject(s, reply::status_type::expectation_failed);
+            return;
+        }
+        expects_continue = true;
+    }
+    if (handler && !request_handler_.accepts_body(handler, s.req, s.rep)) {
+        reject(s);
+        return;
+    }
+
+    auto path = handler ? handler->get_body_file(s.req) : std::string();
+    if (!path.empty()) {
+        try {
+            s.body_file.reset(new file_descriptor(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC));
+        } catch (const std::system_error &e) {
+            log::write("http2_session: cannot store a request body in " + path + ": " + e.what());
+            reject(s, reply::status_type::internal_server_error);
+            return;
+        }
+        s.req.body_file = path;
+    } else if (handler) {
+        s.body_handler = handler->get_body_handler();
+    }
+    if (!s.body_file && !s.body_handler && options_.max_request_body_size &&
+        declared > options_.max_request_body_size) {
+        reject(s, reply::status_type::payload_too_large);
+        return;
+    }
+
+    if (expects_continue) {
+        auto start = out_.size();
+        out_.append(frame_header_size, '\0');
+        hpack::encode_status(100, out_);
+        put_frame_header(&out_[start], out_.size() - start - frame_header_size, headers_frame, end_headers_flag,
+                         s.id);
+        flush();
+    }
+}
+
+bool http::server::http2_session::handle_data(std::uint8_t flags, std::uint32_t id, const char *payload,
+                                              std::size_t length) {
+    if (!id) {
+        go_away(protocol_error);
+        return false;
+    }
+
+    // Flow control counts the whole frame, padding included, whatever becomes of the stream.
+    auto frame_length = std::int64_t(length);
+    receive_window_ -= frame_length;
+    if (receive_window_ < 0) {
+        go_away(flow_control_error);
+        return false;
+    }
+    if (receive_window_ <= receive_window_size / 2) {
+        queue_window_update(0, receive_window_size - receive_window_);
+        receive_window_ = receive_window_size;
+    }
+
+    if (flags & padded_flag) {
+        std::size_t padding = length ? static_cast<unsigned char>(payload[0]) : 0;
+        if (!length || padding >= length) {
+            go_away(protocol_error);
+            return false;
+        }
+        ++payload;
+        length -= padding + 1;
+    }
+
+    auto it = streams_.find(id);
+    if (it == streams_.end()) {
+        if (id > last_stream_id_) {
+            go_away(protocol_error);
+            return false;
+        }
+        reset_stream(id, stream_closed);
+        return true;
+    }
+
+    auto &s = *it->second;
+    if (s.reset)
+        return true;
+    if (s.rejected) {
+        // The reply has been sent or is being sent, the rest of the body is not wanted.
+        s.end_of_request = s.end_of_request || (flags & end_stream_flag);
+        return true;
+    }
+    if (s.end_of_request) {
+        abort_stream(s, stream_closed);
+        return true;
+    }
+    s.receive_window -= frame_length;
+    if (s.receive_window < 0) {
+        abort_stream(s, flow_control_error);
+        return true;
+    }
+    worker_.timers.arm(request_timeout_, std::chrono::seconds(body_timeout_seconds));
+
+    s.received += length;
+    if (s.body_file) {
+        if (!s.body_file->write(payload, length)) {
+            log::write("http2_session: storing a request body in " + s.req.body_file + " failed");
+            s.end_of_request = flags & end_stream_flag;
+            reject(s, reply::status_type::internal_server_error);
+            return true;
+        }
+    } else if (s.body_handler) {
+        (*s.body_handler)(s.req, payload, length);
+    } else if (options_.max_request_body_size && s.received > options_.max_request_body_size) {
+        s.end_of_request = flags & end_stream_flag;
+        reject(s, reply::status_type::payload_too_large);
+        return true;
+    } else {
+        s.req.body.append(payload, length);
+    }
+    if (flags & end_stream_flag) {
+        dispatch(s);
+    } else if (s.receive_window <= receive_window_size / 2) {
+        queue_window_update(id, receive_window_size - s.receive_window);
+        s.receive_window = receive_window_size;
+    }
+    return true;
+}
+
+bool http::server::http2_session::handle_settings(std::uint8_t flags, std::uint32_t id, const char *payload,
+                                                  std::size_t length) {
+    if (id) {
+        go_away(protocol_error);
+        return false;
+    }
+    if ((flags & ack_flag) ? length != 0 : length % 6 != 0) {
+        go_away(frame_size_error);
+        return false;
+    }
+    if (flags & ack_flag)
+        return true;
+
+    for (std::size_t i = 0; i < length; i += 6) {
+        auto setting = read_uint32(payload + i) >> 16;
+        auto value = read_uint32(payload + i + 2);
+        switch (setting) {
+        case settings_enable_push:
+            if (value > 1) {
+                go_away(protocol_error);
+                return false;
+            }
+            break;
+        case settings_initial_window_size:
+            if (value > max_window_size) {
+                go_away(flow_control_error);
+                return false;
+            }
+            // The change applies to the windows of the open streams too.
+            for (auto &s : streams_)
+                s.second->send_window += std::int64_t(value) - initial_send_window_;
+            initial_send_window_ = value;
+            break;
+        case settings_max_frame_size:
+            if (value < max_frame_size || value > largest_frame_size) {
+                go_away(protocol_error);
+                return false;
+            }
+            max_send_frame_ = value;
+            break;
+        default:
+            // The header table size does not matter, the encoder does not use the dynamic table. Unknown settings
+            // must be ignored.
+            break;
+        }
+    }
+
+    queue_frame_header(0, settings_frame, ack_flag, 0);
+    return true;
+}
+
+bool http::server::http2_session::handle_window_update(std::uint32_t id, const char *payload, std::size_t length) {
+    if (length != 4) {
+        go_away(frame_size_error);
+        return false;
+    }
+    auto increment = read_uint32(payload) & 0x7fffffff;
+
+    if (!id) {
+        send_window_ += increment;
+        if (!increment || send_window_ > max_window_size) {
+            go_away(increment ? flow_control_error : protocol_error);
+            return false;
+        }
+        return true;
+    }
+
+    auto it = streams_.find(id);
+    if (it == streams_.end() || it->second->reset)
+        return true;
+    auto &s = *it->second;
+    s.send_window += increment;
+    if (!increment || s.send_window > max_window_size)
+        abort_stream(s, increment ? flow_control_error : protocol_error);
+    return true;
+}
+
+bool http::server::http2_session::handle_rst_stream(std::uint32_t id, const char *payload, std::size_t length) {
+    (void)payload;
+    if (length != 4) {
+        go_away(frame_size_error);
+        return false;
+    }
+    if (!id || id > last_stream_id_) {
+        go_away(protocol_error);
+        return false;
+    }
+
+    auto it = streams_.find(id);
+    if (it != streams_.end()) {
+        if (it->second->handling)
+            it->second->reset = true;
+        else
+            release(id);
+    }
+    return true;
+}
+
+bool http::server::http2_session::make_request(http::server::http2_session::stream &s) {
+    auto &req = s.req;
+    req.http_version_major = 2;
+    req.http_version_minor = 0;
+
+    // The stream keeps the fields for the request to view. They are completed first, as views of the strings
+    // would not survive adding to the list.
+    auto &fields = s.fields;
+    fields.swap(fields_);
+    bool regular = false, has_scheme = false;
+    std::size_t method = 0, path = 0, authority = 0, cookie = 0;
+    for (std::size_t i = 0; i < fields.size(); ++i) {
+        auto &f = fields[i];
+        if (!f.name.empty() && f.name[0] == ':') {
+            // Pseudo-header fields come first, once each.
+            if (regular)
+                return false;
+            if (f.name == ":method" && !method)
+                method = i + 1;
+            else if (f.name == ":path" && !path)
+                path = i + 1;
+            else if (f.name == ":scheme" && !has_scheme)
+                has_scheme = true;
+            else if (f.name == ":authority" && !authority)
+                authority = i + 1;
+            else
+                return false;
+            continue;
+        }
+
+        regular = true;
+        if (std::any_of(f.name.begin(), f.name.end(), [](char c) { return c >= 'A' && c <= 'Z'; }) ||
+            is_connection_specific(f.name) || (f.name == "te" && f.value != "trailers"))
+            return false;
+
+        capitalize(f.name);
+        if (f.name == "Cookie") {
+            // Cookies may be split into several fields, HTTP/1.1 handlers expect a single one.
+            if (cookie) {
+                fields[cookie - 1].value += "; ";
+                fields[cookie - 1].value += f.value;
+                f.name.clear();
+                continue;
+            }
+            cookie = i + 1;
+        }
+    }
+
+    if (!method || !path || fields[method - 1].value.empty() || fields[path - 1].value.empty() || !has_scheme)
+        return false;
+    bool has_host = std::any_of(fields.begin(), fields.end(), [](const header &f) { return f.name == "Host"; });
+    if (authority && !has_host)
+        fields.emplace_back("Host", std::string(fields[authority - 1].value));
+
+    req.method = fields[method - 1].value;
+    req.uri = fields[path - 1].value;
+    for (auto &f : fields) {
+        // Skip the pseudo-header fields and the cookies merged into the first one.
+        if (!f.name.empty() && f.name[0] != ':') {
+            req.headers.push_back({f.name, f.value});
+            req.index_header(req.headers.size() - 1);
+        }
+    }
+    // Content-Length is checked against the DATA frames received: it must say one thing.
+    return !req.has_conflicting_values(known_header::content_length);
+}
+
+void http::server::http2_session::dispatch(http::server::http2_session::stream &s) {
+    s.end_of_request = true;
+    if (auto content_length = s.req.get_header(known_header::content_length)) {
+        std::size_t declared;
+        if (!parse_size(content_length->value, declared) || declared != s.received) {
+            abort_stream(s, protocol_error);
+            return;
+        }
+    }
+
+    s.body_file.reset();
+    s.handling = true;
+    auto owner = owner_.lock();
+    auto id = s.id;
+    if (request_handler_.handle_request<request_handler::protocol_type::https>(
+            s.req, s.rep, worker_.io_service, [this, owner, id]() { this->handle_reply(id); }))
+        handle_reply(id);
+}
+
+void http::server::http2_session::handle_reply(std::uint32_t id) {
+    auto it = streams_.find(id);
+    if (it == streams_.end())
+        return;
+    auto &s = *it->second;
+    s.handling = false;
+    if (s.reset) {
+        release(id);
+        flush();
+        return;
+    }
+
+    auto status = s.rep.status == reply::status_type::undefined ? reply::status_type::internal_server_error
+                                                                : s.rep.status;
+    bool empty = body_of(s.rep).second == 0 && !s.rep.producer;
+
+    // Encode the block in place after room for its frame header.
+    auto start = out_.size();
+    out_.append(frame_header_size, '\0');
+    hpack::encode_status(static_cast<int>(status), out_);
+    for (auto &h : s.rep.headers) {
+        if (!is_connection_specific(h.name))
+            hpack::encode(h.name, h.value, out_);
+    }
+
+    auto block_size = out_.size() - start - frame_header_size;
+    std::uint8_t flags = empty ? end_stream_flag : 0;
+    if (block_size <= max_send_frame_) {
+        put_frame_header(&out_[start], block_size, headers_frame, flags | end_headers_flag, id);
+    } else {
+        // Too large for one frame: split into HEADERS and CONTINUATION frames.
+        std::string block = out_.substr(start + frame_header_size);
+        out_.resize(start);
+        for (std::size_t offset = 0; offset < block.size(); offset += max_send_frame_) {
+            auto size = std::min(max_send_frame_, block.size() - offset);
+            bool last = offset + size == block.size();
+            queue_frame_header(size, offset ? continuation_frame : headers_frame,
+                               (offset ? 0 : flags) | (last ? end_headers_flag : 0), id);
+            out_.append(block, offset, size);
+        }
+    }
+
+    s.replying = true;
+    s.streaming = bool(s.rep.producer);
+    if (empty)
+        finish(s);
+    if (worker_.draining && !going_away_)
+        go_away(no_error);
+    flush();
+}
+
+void http::server::http2_session::queue_data() {
+    for (bool progress = true; progress && !closing_ && send_window_ > 0 && out_.size() < write_batch_size;) {
+        progress = false;
+        for (auto it = streams_.begin(); it != streams_.end() && send_window_ > 0 && out_.size() < write_batch_size;) {
+            auto &s = *it->second;
+            ++it;
+            if (!s.replying || s.send_window <= 0)
+                continue;
+            if (s.streaming && s.sent == s.rep.content.size()) {
+                // The piece has been queued, get the next one.
+                s.rep.content.clear();
+                s.sent = 0;
+                s.streaming = s.rep.producer(s.rep.content, std::max<std::size_t>(options_.stream_window, 1));
+            }
+
+            auto body = body_of(s.rep);
+            auto remaining = body.second - s.sent;
+            auto size = std::min({remaining, max_send_frame_, std::size_t(s.send_window), std::size_t(send_window_)});
+            bool last = size == remaining && !s.streaming;
+            if (!size && !last)
+                continue;
+            queue_frame_header(size, data_frame, last ? end_stream_flag : 0, s.id);
+            out_.append(body.first + s.sent, size);
+            s.sent += size;
+            s.send_window -= size;
+            send_window_ -= size;
+            progress = true;
+            if (last)
+                finish(s);
+        }
+    }
+}
+
+void http::server::http2_session::reject(http::server::http2_session::stream &s,
+                                         http::server::reply::status_type status) {
+    s.rep = reply::stock_reply(status);
+    reject(s);
+}
+
+void http::server::http2_session::reject(http::server::http2_session::stream &s) {
+    s.rejected = true;
+    handle_reply(s.id);
+}
+
+void http::server::http2_session::finish(http::server::http2_session::stream &s) {
+    // A client still sending the body of a request answered early is told to stop (RFC 7540, section 8.1).
+    if (s.rejected && !s.end_of_request)
+        reset_stream(s.id, no_error);
+    release(s.id);
+}
+
+void http::server::http2_session::release(std::uint32_t id) {
+    auto it = streams_.find(id);
+    if (it == streams_.end())
+        return;
+    auto s = std::move(it->second);
+    streams_.erase(it);
+    s->clear();
+    idle_streams_.push_back(std::move(s));
+
+    if (streams_.empty() && !going_away_)
+        worker_.timers.arm(idle_timeout_, std::chrono::seconds(idle_timeout_seconds));
+}
+
+http::server::http2_session::stream_ptr http::server::http2_session::new_stream() {
+    if (idle_streams_.empty())
+        return stream_ptr(new stream());
+    auto s = std::move(idle_streams_.back());
+    idle_streams_.pop_back();
+    return s;
+}
+
+void http::server::http2_session::abort_stream(http::server::http2_session::stream &s,
+                                               http::server::http2_session::error_code code) {
+    reset_stream(s.id, code);
+    if (s.handling)
+        s.reset = true;
+    else
+        release(s.id);
+}
+
+void http::server::http2_session::flush() {
+    if (write_pending_)
+        return;
+    queue_data();
+    if (out_.empty()) {
+        close_if_done();
+        return;
+    }
+
+    writing_.swap(out_);
+    out_.clear();
+    write_pending_ = true;
+    auto owner = owner_.lock();
+    boost::asio::async_write(socket_, boost::asio::buffer(writing_),
+                             [this, owner](const boost::system::error_code &ec, std::size_t) {
+                                 this->handle_write(ec);
+                             });
+}
+
+void http::server::http2_session::handle_write(const boost::system::error_code &ec) {
+    write_pending_ = false;
+    writing_.clear();
+    if (ec) {
+        out_.clear();
+        closing_ = true;
+    } else if (idle_timeout_.armed()) {
+        // A client still reading what it is sent is not idle.
+        worker_.timers.arm(idle_timeout_, std::chrono::seconds(idle_timeout_seconds));
+    }
+    flush();
+    if (read_paused_) {
+        read_paused_ = false;
+        if (!streams_.empty())
+            idle_timeout_.cancel();
+        start_read();
+    }
+}
+
+void http::server::http2_session::go_away(http::server::http2_session::error_code code) {
+    if (closing_)
+        return;
+    queue_frame_header(8, goaway_frame, 0, 0);
+    append_uint32(out_, last_stream_id_);
+    append_uint32(out_, code);
+    going_away_ = true;
+    closing_ = code != no_error;
+}
+
+void http::server::http2_session::reset_stream(std::uint32_t id, http::server::http2_session::error_code code) {
+    queue_frame_header(4, rst_stream_frame, 0, id);
+    append_uint32(out_, code);
+}
+
+void http::server::http2_session::close_if_done() {
+    if (write_pending_ || !out_.empty())
+        return;
+    if (closing_ || read_closed_ || (going_away_ && streams_.empty())) {
+        idle_timeout_.cancel();
+        request_timeout_.cancel();
+        boost::system::error_code ignored_ec;
+        socket_.lowest_layer().close(ignored_ec);
+    }
+}
+
+void http::server::http2_session::handle_idle_timeout() {
+    // A client that has not read what it was sent for that long is not waited for any more.
+    if (write_pending_) {
+        out_.clear();
+        closing_ = true;
+        boost::system::error_code ignored_ec;
+        socket_.lowest_layer().close(ignored_ec);
+        return;
+    }
+    go_away(no_error);
+    flush();
+    if (write_pending_)
+        worker_.timers.arm(idle_timeout_, std::chrono::seconds(idle_timeout_seconds));
+}
+
+bool http::server::http2_session::awaiting_requests() const {
+    if (header_stream_)
+        return true;
+    for (const auto &s : streams_) {
+        if (!s.second->end_of_request && !s.second->rejected && !s.second->reset)
+            return true;
+    }
+    return false;
+}
+
+void http::server::http2_session::handle_request_timeout() {
+    // The rest of a header block cannot be skipped, the dynamic table depends on it.
+    if (header_stream_) {
+        go_away(cancel);
+        flush();
+        return;
+    }
+    std::vector<std::uint32_t> stalled;
+    for (const auto &s : streams_) {
+        if (!s.second->end_of_request && !s.second->rejected && !s.second->reset)
+            stalled.push_back(s.first);
+    }
+    for (auto id : stalled)
+        abort_stream(*streams_[id], cancel);
+    flush();
+}
+
+void http::server::http2_session::queue_frame_header(std::size_t length,
+                                                     http::server::http2_session::frame_type type,
+                                                     std::uint8_t flags, std::uint32_t id) {
+    out_.append(frame_header_size, '\0');
+    put_frame_header(&out_[out_.size() - frame_header_size], length, type, flags, id);
+}
+
+void http::server::http2_session::queue_window_update(std::uint32_t id, std::uint32_t increment) {
+    queue_frame_header(4, window_update_frame, 0, id);
+    append_uint32(out_, increment);
+}
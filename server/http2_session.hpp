@@ -0,0 +1,292 @@
+//
+// http2_session.hpp
+// ~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef HTTP2_SESSION_HPP
+#define HTTP2_SESSION_HPP
+
+#include "file_descriptor.hpp"
+#include "hpack.hpp"
+#include "reply.hpp"
+#include "request.hpp"
+#include "request_handler.hpp"
+#include "server_options.hpp"
+#include "timing_wheel.hpp"
+#include "worker.hpp"
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace http {
+namespace server {
+
+class connection;
+
+/// Serves HTTP/2 (RFC 7540) on a TLS stream whose handshake negotiated "h2" with ALPN.
+///
+/// Every stream carries one request, which goes through the request handler exactly like an HTTP/1.1 request
+/// over TLS, blocking user handlers included; replies are sent on their streams as they complete, in any order.
+/// Reading and writing run independently, so that the flow control and ping frames of the client are processed
+/// while replies are being sent. Response bodies are interleaved between streams one frame at a time, within the
+/// flow control windows granted by the client.
+///
+/// Runs on the io_service of the connection that owns it. The owner is kept alive by the pending operations.
+class http2_session : private boost::noncopyable {
+    public:
+    typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> ssl_socket;
+
+    explicit http2_session(ssl_socket &socket, worker &w, request_handler &handler, const server_options &options);
+
+    /// Send the server's connection preface and start reading the client's.
+    void start(boost::shared_ptr<connection> owner);
+
+    private:
+    enum frame_type : std::uint8_t {
+        data_frame = 0x0,
+        headers_frame = 0x1,
+        priority_frame = 0x2,
+        rst_stream_frame = 0x3,
+        settings_frame = 0x4,
+        push_promise_frame = 0x5,
+        ping_frame = 0x6,
+        goaway_frame = 0x7,
+        window_update_frame = 0x8,
+        continuation_frame = 0x9
+    };
+
+    enum error_code : std::uint32_t {
+        no_error = 0x0,
+        protocol_error = 0x1,
+        internal_error = 0x2,
+        flow_control_error = 0x3,
+        stream_closed = 0x5,
+        frame_size_error = 0x6,
+        refused_stream = 0x7,
+        cancel = 0x8,
+        compression_error = 0x9,
+        enhance_your_calm = 0xb
+    };
+
+    /// A request and its reply.
+    struct stream {
+        std::uint32_t id;
+        request req;
+        reply rep;
+
+        /// The decoded header fields, which the views of req point into.
+        std::vector<header> fields;
+
+        /// The flow control windows: what the client may still send, and what it allows us to send.
+        std::int64_t receive_window, send_window;
+
+        /// The body bytes sent so far. For a streamed reply, the bytes of its content, the current piece.
+        std::size_t sent;
+
+        /// The body bytes received so far, and the file or handler they go to instead of req.body, if any.
+        std::size_t received;
+        std::unique_ptr<file_descriptor> body_file;
+        const user_handler::body_handler *body_handler;
+
+        /// The producer of a streamed reply has more to send.
+        bool streaming;
+
+        /// The client has sent the whole request; the request handler is running; the headers of the reply
+        /// have been sent; the stream was reset while the handler was running; the request was answered without
+        /// being handled, and the rest of its body is discarded.
+        bool end_of_request, handling, replying, reset, rejected;
+
+        void clear();
+    };
+
+    typedef std::unique_ptr<stream> stream_ptr;
+
+    void start_read();
+
+    void handle_read(const boost::system::error_code &ec, std::size_t bytes_transferred);
+
+    /// Process the complete frames that have been read. Returns false once the connection has failed.
+    bool process_frames();
+
+    bool handle_frame(std::uint8_t type, std::uint8_t flags, std::uint32_t id, const char *payload,
+                      std::size_t length);
+
+    bool handle_headers(std::uint8_t flags, std::uint32_t id, const char *payload, std::size_t length);
+
+    bool handle_continuation(std::uint8_t flags, std::uint32_t id, const char *payload, std::size_t length);
+
+    /// Decode the header block received for header_stream_ and start its request.
+    bool end_headers();
+
+    bool handle_data(std::uint8_t flags, std::uint32_t id, const char *payload, std::size_t length);
+
+    bool handle_settings(std::uint8_t flags, std::uint32_t id, const char *payload, std::size_t length);
+
+    bool handle_window_update(std::uint32_t id, const char *payload, std::size_t length);
+
+    bool handle_rst_stream(std::uint32_t id, const char *payload, std::size_t length);
+
+    /// Fill in the request of a new stream from its decoded header fields. Returns false if they do not form a
+    /// valid HTTP/2 request.
+    bool make_request(stream &s);
+
+    /// The status of the reply to a request over the limits of server_options, or ok if it is within them.
+    reply::status_type check_limits(const request &req) const;
+
+    /// The whole request has arrived: hand it to the request handler.
+    void dispatch(stream &s);
+
+    /// The reply of a stream is complete: queue its headers.
+    void handle_reply(std::uint32_t id);
+
+    /// Queue as many DATA frames as the flow control windows allow, round robin between the streams.
+    void queue_data();
+
+    /// A request with a body has arrived: decide where its body goes, or whether it is wanted at all.
+    void begin_body(stream &s);
+
+    /// Answer a request with a stock reply without handling it, for example when its body is too large.
+    void reject(stream &s, reply::status_type status);
+
+    /// Answer a request with the reply already in s.rep without handling it.
+    void reject(stream &s);
+
+    /// The reply of a stream has been queued completely: forget it.
+    void finish(stream &s);
+
+    /// Forget a stream whose reply has been queued or that was reset.
+    void release(std::uint32_t id);
+
+    stream_ptr new_stream();
+
+    /// Start writing what has been queued, unless a write is already in progress.
+    void flush();
+
+    void handle_write(const boost::system::error_code &ec);
+
+    /// Queue a GOAWAY frame and stop accepting streams. With an error, the connection is closed as soon as the
+    /// frame is sent; without, once the open streams are done.
+    void go_away(error_code code);
+
+    /// Reject a stream with RST_STREAM.
+    void reset_stream(std::uint32_t id, error_code code);
+
+    /// Reset an open stream. It is forgotten right away, or once its handler is done if it is running.
+    void abort_stream(stream &s, error_code code);
+
+    /// Close the connection if nothing is left to do.
+    void close_if_done();
+
+    void handle_idle_timeout();
+
+    /// Whether a request is still being received: the rest of a header block, or the body of an open stream.
+    bool awaiting_requests() const;
+
+    /// No request being received has made progress for a while: reset the streams that are waiting for theirs.
+    void handle_request_timeout();
+
+    void queue_frame_header(std::size_t length, frame_type type, std::uint8_t flags, std::uint32_t id);
+
+    void queue_window_update(std::uint32_t id, std::uint32_t increment);
+
+    ssl_socket &socket_;
+
+    worker &worker_;
+
+    request_handler &request_handler_;
+
+    const server_options &options_;
+
+    /// The connection owning the session, locked by every operation started.
+    boost::weak_ptr<connection> owner_;
+
+    /// Frames read but not processed yet, between in_begin_ and in_end_.
+    std::vector<char> in_;
+    std::size_t in_begin_, in_end_;
+
+    /// Whether the client's connection preface has been received.
+    bool preface_received_;
+
+    /// Frames queued for the next write, and the frames being written.
+    std::string out_, writing_;
+
+    bool write_pending_;
+
+    std::map<std::uint32_t, stream_ptr> streams_;
+
+    /// Finished streams kept for the capacity of their strings.
+    std::vector<stream_ptr> idle_streams_;
+
+    /// The highest stream the client has opened.
+    std::uint32_t last_stream_id_;
+
+    /// The stream whose header block is being received in CONTINUATION frames, or 0, and what has been
+    /// received of it.
+    std::uint32_t header_stream_;
+    std::uint8_t header_flags_;
+    std::string header_block_;
+
+    /// The decoded fields of the last header block.
+    std::vector<header> fields_;
+
+    hpack::decoder decoder_;
+
+    /// The connection-level flow control windows.
+    std::int64_t receive_window_, send_window_;
+
+    /// The client's SETTINGS_INITIAL_WINDOW_SIZE and SETTINGS_MAX_FRAME_SIZE.
+    std::int64_t initial_send_window_;
+    std::size_t max_send_frame_;
+
+    /// A GOAWAY frame has been sent, or received. In either case no new streams are started.
+    bool going_away_;
+
+    /// The connection is closed as soon as the queued frames are sent.
+    bool closing_;
+
+    /// The client has closed its side of the connection, or reading failed.
+    bool read_closed_;
+
+    /// Reading waits for the frames queued to be written, the client not reading them fast enough.
+    bool read_paused_;
+
+    /// Closes the connection once it has had no open streams for a while, or has not read what it was sent.
+    timing_wheel::entry idle_timeout_;
+
+    /// Armed by every frame of a request that is still being received, as the reads of request bodies are in
+    /// HTTP/1.1, so that streams waiting for a body the client never sends do not hold the connection.
+    timing_wheel::entry request_timeout_;
+
+    static constexpr std::size_t frame_header_size = 9;
+    static constexpr std::size_t max_frame_size = 16384;
+    static constexpr std::uint32_t max_concurrent_streams = 100;
+
+    /// The windows granted to the client, larger than the default so that uploads are not throttled by round
+    /// trips. They are replenished once half used.
+    static constexpr std::int64_t receive_window_size = 1 << 20;
+
+    /// Stop queueing DATA frames once a write has this many bytes.
+    static constexpr std::size_t write_batch_size = 65536;
+
+    static constexpr std::size_t max_header_block_size = 65536;
+
+    static constexpr int idle_timeout_seconds = 15;
+
+    static constexpr int body_timeout_seconds = 15;
+};
+}
+}
+
+#endif // HTTP2_SESSION_HPP
@@ -8,3 +8,93 @@
 // Distributed under the Boost Software License, Version 1.0. (See accompanying
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 //
+
+#include "io_service_pool.hpp"
+#include "log.hpp"
+#include <random>
+
+http::server::io_service_pool::io_service_pool(std::size_t pool_size, const http::server::affinity_policy &affinity,
+                                               http::server::placement_strategy placement)
+    : connections_(0), placement_(placement), next_io_service_(0) {
+    //        if (pool_size == 0)
+    //            throw std::runtime_error("io_service_pool size is 0");
+
+    // Give all the io_services work to do so that their run() functions will not
+    // exit until they are explicitly stopped.
+    auto cpus = cpu_affinity::assign(affinity, pool_size);
+    for (std::size_t i = 0; i < pool_size; ++i) {
+        workers_.emplace_back(new worker(i, cpus[i], connections_));
+        work_.emplace_back(new boost::asio::io_service::work(workers_.back()->io_service));
+    }
+}
+
+void http::server::io_service_pool::run() {
+    // Create a pool of threads to run all of the io_services.
+    std::vector<std::future<void>> threads;
+    for (std::size_t i = 0; i < workers_.size(); ++i) {
+        threads.emplace_back(std::async(std::launch::async, [this, i]() {
+            auto &w = *workers_[i];
+            if (w.cpu >= 0 && !cpu_affinity::pin_current_thread(w.cpu))
+                log::write("io_service_pool: could not pin thread " + std::to_string(i) + " to CPU " +
+                           std::to_string(w.cpu));
+            w.io_service.run();
+        }));
+    }
+}
+
+void http::server::io_service_pool::stop() {
+    // Explicitly stop all io_services.
+    for (auto &w : workers_)
+        w->io_service.stop();
+}
+
+void http::server::io_service_pool::drain() {
+    for (auto &w : workers_)
+        w->draining = true;
+    work_.clear();
+}
+
+http::server::worker &http::server::io_service_pool::get_worker() {
+    std::size_t index = 0;
+    switch (placement_) {
+    case placement_strategy::round_robin:
+        index = next_io_service_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+        break;
+    case placement_strategy::least_connections:
+        index = least_loaded(&io_service_load::connections);
+        break;
+    case placement_strategy::least_queued_handlers:
+        index = least_loaded(&io_service_load::queued_handlers);
+        break;
+    case placement_strategy::power_of_two_choices: {
+        auto first = random_index(), second = random_index();
+        auto load_of = [this](std::size_t i) {
+            return workers_[i]->load.connections.load(std::memory_order_relaxed);
+        };
+        index = load_of(second) < load_of(first) ? second : first;
+        break;
+    }
+    }
+    return *workers_[index];
+}
+
+std::size_t http::server::io_service_pool::least_loaded(const std::atomic<std::size_t> io_service_load::*counter) {
+    // Start the scan at a rotating position so that ties are spread instead of all landing on the first worker.
+    auto start = next_io_service_.fetch_add(1, std::memory_order_relaxed);
+    std::size_t best = start % workers_.size();
+    std::size_t best_load = (workers_[best]->load.*counter).load(std::memory_order_relaxed);
+    for (std::size_t n = 1; n < workers_.size() && best_load; ++n) {
+        auto i = (start + n) % workers_.size();
+        auto load = (workers_[i]->load.*counter).load(std::memory_order_relaxed);
+        if (load < best_load) {
+            best = i;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+std::size_t http::server::io_service_pool::random_index() const {
+    thread_local std::minstd_rand generator(std::random_device{}());
+    return std::uniform_int_distribution<std::size_t>(0, workers_.size() - 1)(generator);
+}
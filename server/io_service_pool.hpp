@@ -12,12 +12,16 @@
 #ifndef IO_SERVICE_POOL_HPP
 #define IO_SERVICE_POOL_HPP
 
+#include "cpu_affinity.hpp"
+#include "worker.hpp"
+#include <atomic>
 #include <boost/asio/io_service.hpp>
 #include <boost/bind.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/thread.hpp>
 #include <future>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -25,62 +29,76 @@
 namespace http {
 namespace server {
 
+/// How io_service_pool::get_worker() chooses the io_service for a new connection.
+enum class placement_strategy {
+    /// Cycle through the io_services.
+    round_robin,
+    /// The io_service with the fewest active connections.
+    least_connections,
+    /// The io_service with the fewest responses in progress.
+    least_queued_handlers,
+    /// Sample two io_services at random and take the one with fewer active connections.
+    power_of_two_choices
+};
+
 /// A pool of io_service objects.
 class io_service_pool : private boost::noncopyable {
-    typedef boost::shared_ptr<boost::asio::io_service> io_service_ptr;
     typedef boost::shared_ptr<boost::asio::io_service::work> work_ptr;
 
     public:
-    /// Construct the io_service pool.
-    explicit io_service_pool(std::size_t pool_size) : next_io_service_(0) {
-        //        if (pool_size == 0)
-        //            throw std::runtime_error("io_service_pool size is 0");
-
-        // Give all the io_services work to do so that their run() functions will not
-        // exit until they are explicitly stopped.
-        for (std::size_t i = 0; i < pool_size; ++i) {
-            io_service_ptr io_service(new boost::asio::io_service);
-            work_ptr work(new boost::asio::io_service::work(*io_service));
-            io_services_.push_back(io_service);
-            work_.push_back(work);
-        }
-    }
+    /// Construct the io_service pool. The threads started by run() are pinned according to the affinity policy.
+    explicit io_service_pool(std::size_t pool_size, const affinity_policy &affinity = affinity_policy(),
+                             placement_strategy placement = placement_strategy::round_robin);
 
     /// Run all io_service objects in the pool.
-    void run() {
-        // Create a pool of threads to run all of the io_services.
-        std::vector<std::future<void>> threads;
-        for (std::size_t i = 0; i < io_services_.size(); ++i) {
-            threads.emplace_back(std::async(std::launch::async, [this, i]() { io_services_[i]->run(); }));
-        }
-    }
+    void run();
 
     /// Stop all io_service objects in the pool.
-    void stop() {
-        // Explicitly stop all io_services.
-        for (std::size_t i = 0; i < io_services_.size(); ++i)
-            io_services_[i]->stop();
-    }
+    void stop();
+
+    /// Let the io_services run out of work instead of stopping them: run() returns once every connection
+    /// has finished. Connections stop keeping alive.
+    void drain();
+
+    /// Get the number of io_service objects in the pool.
+    std::size_t size() const { return workers_.size(); }
+
+    /// Get the worker at the given position in the pool.
+    worker &get_worker(std::size_t index) { return *workers_[index]; }
+
+    /// Choose a worker for a new connection according to the placement strategy. Safe to call from any thread.
+    worker &get_worker();
+
+    /// Get the io_service at the given position in the pool.
+    boost::asio::io_service &get_io_service(std::size_t index) { return workers_[index]->io_service; }
+
+    /// Get the CPU the thread of the io_service at the given position is pinned to, or -1 if it isn't pinned.
+    int get_cpu(std::size_t index) const { return workers_[index]->cpu; }
 
     /// Get an io_service to use.
-    boost::asio::io_service &get_io_service() {
-        // Use a round-robin scheme to choose the next io_service to use.
-        boost::asio::io_service &io_service = *io_services_[next_io_service_];
-        ++next_io_service_;
-        if (next_io_service_ == io_services_.size())
-            next_io_service_ = 0;
-        return io_service;
-    }
+    boost::asio::io_service &get_io_service() { return get_worker().io_service; }
+
+    /// The number of connections running on all the io_services.
+    std::size_t connections() const { return connections_.load(std::memory_order_relaxed); }
 
     private:
+    std::size_t least_loaded(const std::atomic<std::size_t> io_service_load::*counter);
+
+    std::size_t random_index() const;
+
+    /// Shared by the workers, so it must outlive them.
+    std::atomic<std::size_t> connections_;
+
     /// The pool of io_services.
-    std::vector<io_service_ptr> io_services_;
+    std::vector<std::unique_ptr<worker>> workers_;
 
     /// The work that keeps the io_services running.
     std::vector<work_ptr> work_;
 
+    placement_strategy placement_;
+
     /// The next io_service to use for a connection.
-    std::size_t next_io_service_;
+    std::atomic<std::size_t> next_io_service_;
 };
 
 } // namespace server
@@ -0,0 +1,284 @@
+//
+// listener.cpp
+// ~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "listener.hpp"
+#include "log.hpp"
+#include <cerrno>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port_option;
+#ifdef SO_INCOMING_CPU
+typedef boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_INCOMING_CPU> incoming_cpu_option;
+#endif
+
+/// How long to wait before accepting again once out of descriptors or memory.
+constexpr int accept_retry_milliseconds = 100;
+
+/// The reply to connections turned away by an overloaded server, serialized once.
+const std::string &overload_response() {
+    static const std::string response = []() {
+        auto rep = http::server::reply::stock_reply(http::server::reply::status_type::service_unavailable);
+        std::string s;
+        for (auto &b : rep.to_buffers())
+            s.append(boost::asio::buffer_cast<const char *>(b), boost::asio::buffer_size(b));
+        return s;
+    }();
+    return response;
+}
+}
+
+http::server::listener::listener(boost::asio::io_service &io_service,
+                                 http::server::listener::worker_selector select_worker,
+                                 http::server::listener::handler_selector select_handler,
+                                 boost::asio::ssl::context &ssl_context,
+                                 const http::server::server_options &options, http::server::server_metrics &metrics)
+    : io_service_(io_service), acceptor_(io_service), ssl_acceptor_(io_service), retry_timer_(io_service),
+      ssl_retry_timer_(io_service), unlogged_accept_errors_(0), select_worker_(select_worker),
+      accept_socket_(io_service), ssl_accept_socket_(io_service), select_handler_(select_handler),
+      ssl_context_(ssl_context), options_(options), metrics_(metrics) {}
+
+void http::server::listener::listen(const tcp::endpoint &endpoint, const tcp::endpoint &ssl_endpoint,
+                                    bool reuse_port, int incoming_cpu) {
+    open(acceptor_, endpoint, reuse_port, incoming_cpu);
+    open(ssl_acceptor_, ssl_endpoint, reuse_port, incoming_cpu);
+}
+
+void http::server::listener::open(tcp::acceptor &acceptor, const tcp::endpoint &endpoint, bool reuse_port,
+                                  int incoming_cpu) {
+    // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(tcp::acceptor::reuse_address(true));
+    if (reuse_port)
+        acceptor.set_option(reuse_port_option(true));
+    if (incoming_cpu >= 0) {
+#ifdef SO_INCOMING_CPU
+        boost::system::error_code ec;
+        acceptor.set_option(incoming_cpu_option(incoming_cpu), ec);
+        if (ec)
+            log::write("listener: could not set SO_INCOMING_CPU: " + ec.message());
+#endif
+    }
+    acceptor.bind(endpoint);
+    acceptor.listen();
+}
+
+void http::server::listener::adopt(const tcp::endpoint &endpoint, const tcp::endpoint &ssl_endpoint, int fd,
+                                   int ssl_fd) {
+    acceptor_.assign(endpoint.protocol(), fd);
+    ssl_acceptor_.assign(ssl_endpoint.protocol(), ssl_fd);
+}
+
+void http::server::listener::start() {
+    if (options_.batch_accept) {
+        // accept4() must fail with EAGAIN once the backlog is empty rather than block the thread.
+        acceptor_.native_non_blocking(true);
+        ssl_acceptor_.native_non_blocking(true);
+        start_batch_accept(acceptor_, false);
+        start_batch_accept(ssl_acceptor_, true);
+    } else {
+        start_accept();
+        start_ssl_accept();
+    }
+}
+
+void http::server::listener::stop() {
+    io_service_.post([this]() {
+        boost::system::error_code ignored_ec;
+        acceptor_.close(ignored_ec);
+        ssl_acceptor_.close(ignored_ec);
+        retry_timer_.cancel(ignored_ec);
+        ssl_retry_timer_.cancel(ignored_ec);
+    });
+}
+
+std::vector<int> http::server::listener::native_handles() {
+    return {acceptor_.native_handle(), ssl_acceptor_.native_handle()};
+}
+
+void http::server::listener::start_accept() {
+    acceptor_.async_accept(accept_socket_, [this](const auto &e) { this->handle_accept(e); });
+}
+
+void http::server::listener::start_ssl_accept() {
+    ssl_acceptor_.async_accept(ssl_accept_socket_, [this](const auto &e) { this->handle_ssl_accept(e); });
+}
+
+void http::server::listener::handle_accept(const boost::system::error_code &e) {
+    if (!acceptor_.is_open())
+        return;
+    if (!e) {
+        ++metrics_.accepted;
+        hand_over(accept_socket_, false);
+    } else if (out_of_resources(e)) {
+        retry_accept(retry_timer_, e, [this]() { this->start_accept(); });
+        return;
+    }
+
+    start_accept();
+}
+
+void http::server::listener::handle_ssl_accept(const boost::system::error_code &e) {
+    if (!ssl_acceptor_.is_open())
+        return;
+    if (!e) {
+        ++metrics_.accepted;
+        hand_over(ssl_accept_socket_, true);
+    } else if (out_of_resources(e)) {
+        retry_accept(ssl_retry_timer_, e, [this]() { this->start_ssl_accept(); });
+        return;
+    }
+
+    start_ssl_accept();
+}
+
+void http::server::listener::start_batch_accept(tcp::acceptor &acceptor, bool ssl) {
+    acceptor.async_wait(tcp::acceptor::wait_read,
+                        [this, &acceptor, ssl](const auto &e) { this->handle_batch_accept(acceptor, ssl, e); });
+}
+
+void http::server::listener::handle_batch_accept(tcp::acceptor &acceptor, bool ssl,
+                                                 const boost::system::error_code &e) {
+    if (!acceptor.is_open())
+        return;
+    if (!e) {
+        boost::system::error_code ec;
+        auto protocol = acceptor.local_endpoint(ec).protocol();
+        std::size_t accepted = 0;
+        while (accepted < max_accept_batch) {
+            int fd = ::accept4(acceptor.native_handle(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                boost::system::error_code error(errno, boost::asio::error::get_system_category());
+                if (out_of_resources(error)) {
+                    record_batch(accepted);
+                    retry_accept(ssl ? ssl_retry_timer_ : retry_timer_, error,
+                                 [this, &acceptor, ssl]() { this->start_batch_accept(acceptor, ssl); });
+                    return;
+                }
+                log::write("listener: accept failed: " + error.message());
+                break;
+            }
+            start_connection(fd, protocol, ssl);
+            ++accepted;
+        }
+        record_batch(accepted);
+    }
+
+    start_batch_accept(acceptor, ssl);
+}
+
+void http::server::listener::hand_over(tcp::socket &socket, bool ssl) {
+    boost::system::error_code ec;
+    auto protocol = socket.local_endpoint(ec).protocol();
+    int fd = socket.release(ec);
+    if (ec) {
+        log::write("listener: could not release an accepted socket: " + ec.message());
+        boost::system::error_code ignored_ec;
+        socket.close(ignored_ec);
+        return;
+    }
+    start_connection(fd, protocol, ssl);
+}
+
+void http::server::listener::start_connection(int fd, const tcp &protocol, bool ssl) {
+    auto &w = select_worker_();
+    if (!admit(w)) {
+        turn_away(fd, ssl);
+        ::close(fd);
+        return;
+    }
+
+    connection_ptr c;
+    if (ssl)
+        c = w.connections.make_ssl_connection(w, ssl_context_, select_handler_(w), options_);
+    else
+        c = w.connections.make_connection(w, select_handler_(w), options_);
+
+    boost::system::error_code ec;
+    c->socket().assign(protocol, fd, ec);
+    if (ec) {
+        log::write("listener: could not assign an accepted socket: " + ec.message());
+        ::close(fd);
+        return;
+    }
+    c->start();
+}
+
+void http::server::listener::record_batch(std::size_t accepted) {
+    if (!accepted)
+        return;
+    metrics_.accepted += accepted;
+    ++metrics_.accept_batches;
+    auto largest = metrics_.largest_accept_batch.load();
+    while (accepted > largest && !metrics_.largest_accept_batch.compare_exchange_weak(largest, accepted)) {
+    }
+}
+
+bool http::server::listener::out_of_resources(const boost::system::error_code &e) {
+    return e == boost::asio::error::no_descriptors || e == boost::asio::error::no_buffer_space ||
+           e == boost::asio::error::no_memory ||
+           (e.category() == boost::asio::error::get_system_category() && e.value() == ENFILE);
+}
+
+void http::server::listener::retry_accept(boost::asio::steady_timer &timer, const boost::system::error_code &e,
+                                          std::function<void()> retry) {
+    // The error usually lasts as long as the load that caused it: report it, not every retry.
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_accept_error_ >= std::chrono::seconds(1)) {
+        std::string message = "listener: accept failed: " + e.message();
+        if (unlogged_accept_errors_)
+            message += " (" + std::to_string(unlogged_accept_errors_) + " more since the last report)";
+        log::write(message);
+        last_accept_error_ = now;
+        unlogged_accept_errors_ = 0;
+    } else {
+        ++unlogged_accept_errors_;
+    }
+
+    timer.expires_from_now(std::chrono::milliseconds(accept_retry_milliseconds));
+    timer.async_wait([retry](const boost::system::error_code &ec) {
+        // Cancelled when the listener stops.
+        if (!ec)
+            retry();
+    });
+}
+
+bool http::server::listener::admit(http::server::worker &w) {
+    if (options_.max_connections && w.pool_connections.load(std::memory_order_relaxed) >= options_.max_connections) {
+        ++metrics_.rejected_by_global_limit;
+        return false;
+    }
+    if (options_.max_connections_per_thread &&
+        w.load.connections.load(std::memory_order_relaxed) >= options_.max_connections_per_thread) {
+        ++metrics_.rejected_by_thread_limit;
+        return false;
+    }
+    return true;
+}
+
+void http::server::listener::turn_away(int fd, bool ssl) {
+    // A 503 over TLS would cost a handshake, which is what an overloaded server cannot afford.
+    if (!ssl) {
+        const std::string &response = overload_response();
+        ::send(fd, response.data(), response.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+
+    // Discard what the client has already sent: closing a socket with unread data resets the connection,
+    // and the client could lose the reply.
+    char discarded[1024];
+    for (int i = 0; i < 8 && ::recv(fd, discarded, sizeof(discarded), MSG_DONTWAIT) > 0; ++i) {
+    }
+}
@@ -0,0 +1,141 @@
+//
+// listener.hpp
+// ~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef LISTENER_HPP
+#define LISTENER_HPP
+
+#include "connection.hpp"
+#include "request_handler.hpp"
+#include "server_metrics.hpp"
+#include "server_options.hpp"
+#include "ssl_connection.hpp"
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/noncopyable.hpp>
+#include <chrono>
+#include <functional>
+
+namespace http {
+namespace server {
+
+/// A pair of listening sockets, one for HTTP and one for HTTPS, whose accepts run on a single io_service.
+class listener : private boost::noncopyable {
+    public:
+    /// Returns the worker that will run the next accepted connection.
+    typedef std::function<worker &()> worker_selector;
+
+    /// Returns the request handler for the connections of a worker.
+    typedef std::function<request_handler &(worker &)> handler_selector;
+
+    /// Construct the acceptors on the given io_service. Accepted connections are placed on the
+    /// worker returned by the worker selector and use that worker's request handler.
+    explicit listener(boost::asio::io_service &io_service, worker_selector select_worker,
+                      handler_selector select_handler, boost::asio::ssl::context &ssl_context,
+                      const server_options &options, server_metrics &metrics);
+
+    /// Open, bind and listen on both endpoints. If reuse_port is set, SO_REUSEPORT is enabled so that
+    /// several listeners can share the same endpoints. A non-negative incoming_cpu sets SO_INCOMING_CPU,
+    /// making the kernel prefer this listener for connections whose packets are processed on that CPU.
+    void listen(const tcp::endpoint &endpoint, const tcp::endpoint &ssl_endpoint, bool reuse_port,
+                int incoming_cpu = -1);
+
+    /// Take over already listening sockets, for example ones inherited from a previous process.
+    void adopt(const tcp::endpoint &endpoint, const tcp::endpoint &ssl_endpoint, int fd, int ssl_fd);
+
+    /// Start accepting connections on both sockets. With options.batch_accept the listener waits for the
+    /// sockets to become readable and then accepts with non-blocking accept4() calls until the backlog is
+    /// empty, instead of going back to the reactor after every connection.
+    void start();
+
+    /// Stop accepting and close both sockets. May be called from any thread.
+    void stop();
+
+    /// The descriptors of the listening sockets, HTTP first.
+    std::vector<int> native_handles();
+
+    private:
+    /// Initiate an asynchronous accept operation.
+    void start_accept();
+
+    void start_ssl_accept();
+
+    /// Handle completion of an asynchronous accept operation.
+    void handle_accept(const boost::system::error_code &e);
+
+    void handle_ssl_accept(const boost::system::error_code &e);
+
+    /// Wait until a connection is pending on the acceptor.
+    void start_batch_accept(tcp::acceptor &acceptor, bool ssl);
+
+    /// Accept all the pending connections, up to max_accept_batch.
+    void handle_batch_accept(tcp::acceptor &acceptor, bool ssl, const boost::system::error_code &e);
+
+    /// Start a connection on a socket accepted by async_accept, which is left closed.
+    void hand_over(tcp::socket &socket, bool ssl);
+
+    /// Start a connection on an accepted socket.
+    void start_connection(int fd, const tcp &protocol, bool ssl);
+
+    void record_batch(std::size_t accepted);
+
+    /// Whether an accept failed for lack of descriptors or memory. The connection stays in the backlog and the
+    /// socket stays readable, so accepting again right away would spin.
+    static bool out_of_resources(const boost::system::error_code &e);
+
+    /// Log a failed accept, at most once a second, and call retry on the io_service once the timer expires.
+    void retry_accept(boost::asio::steady_timer &timer, const boost::system::error_code &e,
+                      std::function<void()> retry);
+
+    /// Whether the connection limits allow one more connection on the worker. Counts the rejection if not.
+    bool admit(worker &w);
+
+    /// Send the overload reply on an accepted socket that was not admitted. The caller closes it.
+    static void turn_away(int fd, bool ssl);
+
+    /// Bounds the time spent accepting before other handlers of the io_service get to run.
+    static constexpr std::size_t max_accept_batch = 64;
+
+    static void open(tcp::acceptor &acceptor, const tcp::endpoint &endpoint, bool reuse_port, int incoming_cpu);
+
+    /// The io_service running the accepts.
+    boost::asio::io_service &io_service_;
+
+    /// Acceptors used to listen for incoming connections.
+    tcp::acceptor acceptor_;
+    tcp::acceptor ssl_acceptor_;
+
+    /// Delay accepting again on each acceptor after running out of resources.
+    boost::asio::steady_timer retry_timer_;
+    boost::asio::steady_timer ssl_retry_timer_;
+
+    /// When a failed accept was last logged, and how many failed since without being logged.
+    std::chrono::steady_clock::time_point last_accept_error_;
+    std::size_t unlogged_accept_errors_;
+
+    worker_selector select_worker_;
+
+    /// The sockets the next connections are accepted into. An accepted socket is moved to the worker chosen
+    /// then, from its load at that time rather than when the accept was started.
+    tcp::socket accept_socket_;
+    tcp::socket ssl_accept_socket_;
+
+    /// Chooses the handler for the requests of each accepted connection.
+    handler_selector select_handler_;
+
+    boost::asio::ssl::context &ssl_context_;
+
+    const server_options &options_;
+
+    server_metrics &metrics_;
+};
+}
+}
+
+#endif // LISTENER_HPP
@@ -10,11 +10,26 @@
 //
 
 #include "reply.hpp"
+#include "string_utils.hpp"
 
 http::server::reply::reply() : status(status_type::undefined) {}
 
+void http::server::reply::clear() {
+    status = status_type::undefined;
+    headers.clear();
+    content.clear();
+    sendfile = {};
+    memory_mapping.reset();
+    producer = nullptr;
+}
+
 std::vector<boost::asio::const_buffer> http::server::reply::to_buffers() {
     std::vector<boost::asio::const_buffer> buffers;
+    to_buffers(buffers);
+    return buffers;
+}
+
+void http::server::reply::to_buffers(std::vector<boost::asio::const_buffer> &buffers) {
     buffers.push_back(to_buffer(status));
     for (std::size_t i = 0; i < headers.size(); ++i) {
         header &h = headers[i];
@@ -24,16 +39,16 @@ std::vector<boost::asio::const_buffer> http::server::reply::to_buffers() {
         buffers.push_back(boost::asio::buffer(misc_strings::crlf));
     }
     buffers.push_back(boost::asio::buffer(misc_strings::crlf));
+    if (producer)
+        return;
     if (memory_mapping)
         buffers.push_back(boost::asio::const_buffer(&memory_mapping->at(0), memory_mapping->size()));
     else
         buffers.push_back(boost::asio::buffer(content, content.size()));
-
-    return buffers;
 }
 
-http::server::header *http::server::reply::get_header(const std::string &key) {
-    auto it = std::find_if(headers.begin(), headers.end(), [&key](const header &h) { return h.name == key; });
+http::server::header *http::server::reply::get_header(boost::string_view key) {
+    auto it = std::find_if(headers.begin(), headers.end(), [&key](const header &h) { return iequals(h.name, key); });
     return it != headers.end() ? &*it : nullptr;
 }
 
@@ -67,6 +82,16 @@ std::string http::server::reply::to_string(http::server::reply::status_type stat
         return stock_replies::forbidden;
     case reply::status_type::not_found:
         return stock_replies::not_found;
+    case reply::status_type::request_timeout:
+        return stock_replies::request_timeout;
+    case reply::status_type::payload_too_large:
+        return stock_replies::payload_too_large;
+    case reply::status_type::uri_too_long:
+        return stock_replies::uri_too_long;
+    case reply::status_type::expectation_failed:
+        return stock_replies::expectation_failed;
+    case reply::status_type::request_header_fields_too_large:
+        return stock_replies::request_header_fields_too_large;
     case reply::status_type::internal_server_error:
         return stock_replies::internal_server_error;
     case reply::status_type::not_implemented:
@@ -90,41 +115,58 @@ http::server::reply http::server::reply::stock_reply(http::server::reply::status
     return rep;
 }
 
+namespace {
+/// The status line without the string's terminating null character.
+template <std::size_t N> boost::asio::const_buffer status_buffer(const char (&line)[N]) {
+    return boost::asio::buffer(line, N - 1);
+}
+}
+
 boost::asio::const_buffer http::server::reply::to_buffer(http::server::reply::status_type status) {
     switch (status) {
     case reply::status_type::ok:
-        return boost::asio::buffer(status_strings::ok);
+        return status_buffer(status_strings::ok);
     case reply::status_type::created:
-        return boost::asio::buffer(status_strings::created);
+        return status_buffer(status_strings::created);
     case reply::status_type::accepted:
-        return boost::asio::buffer(status_strings::accepted);
+        return status_buffer(status_strings::accepted);
     case reply::status_type::no_content:
-        return boost::asio::buffer(status_strings::no_content);
+        return status_buffer(status_strings::no_content);
     case reply::status_type::multiple_choices:
-        return boost::asio::buffer(status_strings::multiple_choices);
+        return status_buffer(status_strings::multiple_choices);
     case reply::status_type::moved_permanently:
-        return boost::asio::buffer(status_strings::moved_permanently);
+        return status_buffer(status_strings::moved_permanently);
     case reply::status_type::moved_temporarily:
-        return boost::asio::buffer(status_strings::moved_temporarily);
+        return status_buffer(status_strings::moved_temporarily);
     case reply::status_type::not_modified:
-        return boost::asio::buffer(status_strings::not_modified);
+        return status_buffer(status_strings::not_modified);
     case reply::status_type::bad_request:
-        return boost::asio::buffer(status_strings::bad_request);
+        return status_buffer(status_strings::bad_request);
     case reply::status_type::unauthorized:
-        return boost::asio::buffer(status_strings::unauthorized);
+        return status_buffer(status_strings::unauthorized);
     case reply::status_type::forbidden:
-        return boost::asio::buffer(status_strings::forbidden);
+        return status_buffer(status_strings::forbidden);
     case reply::status_type::not_found:
-        return boost::asio::buffer(status_strings::not_found);
+        return status_buffer(status_strings::not_found);
+    case reply::status_type::request_timeout:
+        return status_buffer(status_strings::request_timeout);
+    case reply::status_type::payload_too_large:
+        return status_buffer(status_strings::payload_too_large);
+    case reply::status_type::uri_too_long:
+        return status_buffer(status_strings::uri_too_long);
+    case reply::status_type::expectation_failed:
+        return status_buffer(status_strings::expectation_failed);
+    case reply::status_type::request_header_fields_too_large:
+        return status_buffer(status_strings::request_header_fields_too_large);
     case reply::status_type::internal_server_error:
-        return boost::asio::buffer(status_strings::internal_server_error);
+        return status_buffer(status_strings::internal_server_error);
     case reply::status_type::not_implemented:
-        return boost::asio::buffer(status_strings::not_implemented);
+        return status_buffer(status_strings::not_implemented);
     case reply::status_type::bad_gateway:
-        return boost::asio::buffer(status_strings::bad_gateway);
+        return status_buffer(status_strings::bad_gateway);
     case reply::status_type::service_unavailable:
-        return boost::asio::buffer(status_strings::service_unavailable);
+        return status_buffer(status_strings::service_unavailable);
     default:
-        return boost::asio::buffer(status_strings::internal_server_error);
+        return status_buffer(status_strings::internal_server_error);
     }
 }
@@ -16,6 +16,7 @@
 #include "memory_mapping.hpp"
 #include "sendfile_op.hpp"
 #include <boost/asio.hpp>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <unordered_map>
@@ -70,6 +71,26 @@ static constexpr char not_found[] = "<html>"
                                     "<head><title>Not Found</title></head>"
                                     "<body><h1>404 Not Found</h1></body>"
                                     "</html>";
+static constexpr char request_timeout[] = "<html>"
+                                          "<head><title>Request Timeout</title></head>"
+                                          "<body><h1>408 Request Timeout</h1></body>"
+                                          "</html>";
+static constexpr char payload_too_large[] = "<html>"
+                                            "<head><title>Payload Too Large</title></head>"
+                                            "<body><h1>413 Payload Too Large</h1></body>"
+                                            "</html>";
+static constexpr char uri_too_long[] = "<html>"
+                                       "<head><title>URI Too Long</title></head>"
+                                       "<body><h1>414 URI Too Long</h1></body>"
+                                       "</html>";
+static constexpr char expectation_failed[] = "<html>"
+                                             "<head><title>Expectation Failed</title></head>"
+                                             "<body><h1>417 Expectation Failed</h1></body>"
+                                             "</html>";
+static constexpr char request_header_fields_too_large[] = "<html>"
+                                                          "<head><title>Request Header Fields Too Large</title></head>"
+                                                          "<body><h1>431 Request Header Fields Too Large</h1></body>"
+                                                          "</html>";
 static constexpr char internal_server_error[] = "<html>"
                                                 "<head><title>Internal Server Error</title></head>"
                                                 "<body><h1>500 Internal Server Error</h1></body>"
@@ -101,6 +122,11 @@ static constexpr char bad_request[] = "HTTP/1.1 400 Bad Request\r\n";
 static constexpr char unauthorized[] = "HTTP/1.1 401 Unauthorized\r\n";
 static constexpr char forbidden[] = "HTTP/1.1 403 Forbidden\r\n";
 static constexpr char not_found[] = "HTTP/1.1 404 Not Found\r\n";
+static constexpr char request_timeout[] = "HTTP/1.1 408 Request Timeout\r\n";
+static constexpr char payload_too_large[] = "HTTP/1.1 413 Payload Too Large\r\n";
+static constexpr char uri_too_long[] = "HTTP/1.1 414 URI Too Long\r\n";
+static constexpr char expectation_failed[] = "HTTP/1.1 417 Expectation Failed\r\n";
+static constexpr char request_header_fields_too_large[] = "HTTP/1.1 431 Request Header Fields Too Large\r\n";
 static constexpr char internal_server_error[] = "HTTP/1.1 500 Internal Server Error\r\n";
 static constexpr char not_implemented[] = "HTTP/1.1 501 Not Implemented\r\n";
 static constexpr char bad_gateway[] = "HTTP/1.1 502 Bad Gateway\r\n";
@@ -113,6 +139,21 @@ static constexpr char crlf[] = {'\r', '\n'};
 
 } // namespace misc_strings
 
+/// A non-owning view of a vector of buffers. Unlike the vector, it can be copied into an asynchronous
+/// operation without allocating.
+struct const_buffers_view {
+    typedef boost::asio::const_buffer value_type;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+    explicit const_buffers_view(const std::vector<value_type> &buffers) : buffers_(&buffers) {}
+
+    const_iterator begin() const { return buffers_->begin(); }
+    const_iterator end() const { return buffers_->end(); }
+
+    private:
+    const std::vector<value_type> *buffers_;
+};
+
 /// A reply to be sent to a client.
 struct reply {
     /// The status of the reply.
@@ -130,6 +171,11 @@ struct reply {
         unauthorized = 401,
         forbidden = 403,
         not_found = 404,
+        request_timeout = 408,
+        payload_too_large = 413,
+        uri_too_long = 414,
+        expectation_failed = 417,
+        request_header_fields_too_large = 431,
         internal_server_error = 500,
         not_implemented = 501,
         bad_gateway = 502,
@@ -148,14 +194,31 @@ struct reply {
     sendfile_op sendfile;
     std::shared_ptr<char_memory_mapping> memory_mapping;
 
+    /// Produces the body of a streamed reply one piece at a time. It is called on the io thread of the connection
+    /// whenever the previous piece has been sent, and appends the next one, of at most the given size and at least
+    /// one byte, to the string. It returns false once the body is complete; what it appended then is the last piece.
+    typedef std::function<bool(std::string &, std::size_t)> body_producer;
+
+    /// When set, the body is streamed: the content, if any, is sent first, then what the producer appends. The
+    /// length is not known in advance, so the body is sent with Transfer-Encoding: chunked, or delimited by
+    /// closing the connection for HTTP/1.0 clients. Memory is bounded by server_options::stream_window per reply.
+    body_producer producer;
+
     /// Convert the reply into a vector of buffers. The buffers do not own the
     /// underlying memory blocks, therefore the reply object must remain valid and
-    /// not be changed until the write operation has completed.
+    /// not be changed until the write operation has completed. The body of a streamed reply is not included.
     std::vector<boost::asio::const_buffer> to_buffers();
 
+    /// Same as above, but appends to the given vector, so that its capacity can be reused and the replies to
+    /// pipelined requests can be written together.
+    void to_buffers(std::vector<boost::asio::const_buffer> &buffers);
+
+    /// Reset to an empty reply, keeping the capacity of the content and of the header list.
+    void clear();
+
     /// Checks to see if the response has a header set. Returns a pointer to
     /// the header object, or null if it doesn't exist
-    header *get_header(const std::string &key);
+    header *get_header(boost::string_view key);
 
     /// Sets a header if it already exists, or creates it
     /// FIXME: verify if the header exists, don't just push it
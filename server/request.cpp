@@ -9,23 +9,103 @@
 //
 
 #include "request.hpp"
+#include "string_utils.hpp"
 #include <algorithm>
 
-http::server::header *http::server::request::get_header(const std::string &key) {
-    auto it = std::find_if(headers.begin(), headers.end(), [&key](const header &h) { return h.name == key; });
+const http::server::request_header *http::server::request::get_header(boost::string_view key) const {
+    auto known = find_known_header(key);
+    if (known != known_header::unknown)
+        return get_header(known);
+
+    const auto mask = other_headers_.size() - 1;
+    for (auto slot = ihash(key) & mask;; slot = (slot + 1) & mask) {
+        auto i = other_headers_[slot];
+        if (!i)
+            break;
+        if (iequals(headers[i - 1].name, key))
+            return &headers[i - 1];
+    }
+    if (!other_headers_overflow_)
+        return nullptr;
+    auto it = std::find_if(headers.cbegin(), headers.cend(),
+                           [&key](const request_header &h) { return iequals(h.name, key); });
     return it != headers.end() ? &*it : nullptr;
 }
 
-const http::server::header *http::server::request::get_header(const std::string &key) const {
-    auto it = std::find_if(headers.cbegin(), headers.cend(), [&key](const header &h) { return h.name == key; });
-    return it != headers.end() ? &*it : nullptr;
+const http::server::request_header *http::server::request::get_header(http::server::known_header key) const {
+    auto i = known_headers_[static_cast<std::size_t>(key)];
+    return i ? &headers[i - 1] : nullptr;
+}
+
+bool http::server::request::is_repeated(http::server::known_header key) const {
+    return repeated_known_headers_ & (std::uint32_t(1) << static_cast<std::size_t>(key));
+}
+
+bool http::server::request::has_conflicting_values(http::server::known_header key) const {
+    if (!is_repeated(key))
+        return false;
+    const auto &first = *get_header(key);
+    return std::any_of(headers.cbegin(), headers.cend(), [&first, key](const request_header &h) {
+        return h.value != first.value && find_known_header(h.name) == key;
+    });
+}
+
+void http::server::request::index_header(std::size_t i) {
+    static_assert(known_header_count <= 32, "repeated_known_headers_ has a bit per known header");
+    const auto &name = headers[i].name;
+    auto known = find_known_header(name);
+    if (known != known_header::unknown) {
+        auto &slot = known_headers_[static_cast<std::size_t>(known)];
+        if (!slot)
+            slot = i + 1;
+        else
+            repeated_known_headers_ |= std::uint32_t(1) << static_cast<std::size_t>(known);
+        return;
+    }
+
+    if (other_header_count_ >= other_headers_.size() / 4 * 3) {
+        other_headers_overflow_ = true;
+        return;
+    }
+    const auto mask = other_headers_.size() - 1;
+    for (auto slot = ihash(name) & mask;; slot = (slot + 1) & mask) {
+        auto &entry = other_headers_[slot];
+        if (!entry) {
+            entry = i + 1;
+            ++other_header_count_;
+            return;
+        }
+        if (iequals(headers[entry - 1].name, name))
+            return;
+    }
 }
 
-const std::string &http::server::request::read_body() {
-    try {
-        read_body_func();
-        return body;
-    } catch (...) {
-        throw;
+const std::string &http::server::request::read_body() const { return body; }
+
+void http::server::request::rebase(const char *from, const char *to) {
+    auto move = [from, to](boost::string_view &view) {
+        if (!view.empty())
+            view = boost::string_view(to + (view.data() - from), view.size());
+    };
+    move(method);
+    move(uri);
+    for (auto &h : headers) {
+        move(h.name);
+        move(h.value);
     }
 }
+
+void http::server::request::clear() {
+    method.clear();
+    uri.clear();
+    http_version_major = 0;
+    http_version_minor = 0;
+    headers.clear();
+    known_headers_.fill(0);
+    repeated_known_headers_ = 0;
+    other_headers_.fill(0);
+    other_header_count_ = 0;
+    other_headers_overflow_ = false;
+    body.clear();
+    body_file.clear();
+}
@@ -12,31 +12,78 @@
 #define HTTP_SERVER3_REQUEST_HPP
 
 #include "header.hpp"
-#include <functional>
+#include <array>
+#include <boost/utility/string_view.hpp>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 namespace http {
 namespace server {
 
+/// A header field of a request.
+struct request_header {
+    boost::string_view name;
+    boost::string_view value;
+};
+
 /// A request received from a client.
+///
+/// The method, the URI and the header fields are views of the bytes the connection read, so parsing a request
+/// copies nothing. They are valid until the request is answered: until the user handler returns, or, for an
+/// asynchronous handler, calls its completion. A handler that keeps any of them longer must copy it, with
+/// to_string().
 struct request {
-    std::string method;
-    std::string uri;
+    boost::string_view method;
+    boost::string_view uri;
     int http_version_major;
     int http_version_minor;
-    std::vector<header> headers;
+    std::vector<request_header> headers;
     std::string body;
 
-    header *get_header(const std::string &key);
+    /// The file the body was stored in instead of body, if its user handler stores bodies in files.
+    std::string body_file;
+
+    /// Get the first header field with the given name, compared case-insensitively, or nullptr. Known headers
+    /// are found in their slot, others in a small hash table, and neither allocates.
+    const request_header *get_header(boost::string_view key) const;
+
+    const request_header *get_header(known_header key) const;
+
+    /// Whether more than one field of the known header key was received.
+    bool is_repeated(known_header key) const;
+
+    /// Whether the fields of the known header key do not all have the same value.
+    bool has_conflicting_values(known_header key) const;
 
-    const header *get_header(const std::string &key) const;
-    const std::string &read_body();
-    friend class connection;
-    friend class ssl_connection;
+    /// Add headers[i] to the index get_header looks in. Whoever adds to headers must call it, once the name of
+    /// the field is complete.
+    void index_header(std::size_t i);
+
+    /// Get the body of the request. The connection reads it before the request is handled, so this never
+    /// waits for the client.
+    const std::string &read_body() const;
+
+    /// The bytes the views look into have moved from from to to: make the views follow them.
+    void rebase(const char *from, const char *to);
+
+    /// Reset to an empty request, keeping the capacity of the strings and of the header list.
+    void clear();
 
     private:
-    std::function<void(void)> read_body_func;
+    /// Where the first field of every known header is in headers, plus one, or 0.
+    std::array<std::uint32_t, known_header_count> known_headers_{};
+
+    /// The known headers with more than one field, one bit each.
+    std::uint32_t repeated_known_headers_ = 0;
+
+    /// The first fields of other headers, by ihash of their name with linear probing, as for known_headers_. It
+    /// is filled to three quarters at most, so that a probe always ends at an empty slot.
+    std::array<std::uint32_t, 64> other_headers_{};
+    std::size_t other_header_count_ = 0;
+
+    /// Some headers did not fit in other_headers_, so a name not found there may still be in headers.
+    bool other_headers_overflow_ = false;
 };
 
 } // namespace server3
@@ -16,8 +16,10 @@
 #include <boost/iostreams/filtering_streambuf.hpp>
 
 http::server::request_handler::request_handler(const std::string &doc_root, const std::string &compression_folder,
-                                               const std::vector<http::server::user_handler> &user_handlers)
-    : doc_root_(doc_root), compression_folder_(compression_folder), user_handlers_(user_handlers) {}
+                                               const std::vector<http::server::user_handler> &user_handlers,
+                                               http::server::blocking_pool *offload, bool shared)
+    : doc_root_(doc_root), compression_folder_(compression_folder), user_handlers_(user_handlers),
+      offload_(offload), file_descriptors_(shared), memory_mappings_(file_descriptors_, shared) {}
 
 const http::server::user_handler *
 http::server::request_handler::get_user_handler(const http::server::request &req) const {
@@ -29,30 +31,57 @@ http::server::request_handler::get_user_handler(const http::server::request &req
     return nullptr;
 }
 
+bool http::server::request_handler::accepts_body(const http::server::user_handler *handler,
+                                                 const http::server::request &req, http::server::reply &rep) const {
+    if (handler->accepts_body(req, rep))
+        return true;
+    if (rep.status == reply::status_type::undefined) {
+        rep = reply::stock_reply(reply::status_type::expectation_failed);
+        return false;
+    }
+    complete_user_reply(req, rep);
+    if (!rep.producer && !rep.get_header("Content-Length"))
+        rep.add_header("Content-Length", std::to_string(rep.content.size()));
+    return false;
+}
+
 void http::server::request_handler::invoke_user_handler(http::server::request &req, http::server::reply &rep,
                                                         const http::server::user_handler *u_handler) const {
     u_handler->invoke(req, rep);
+    complete_user_reply(req, rep);
+}
 
+void http::server::request_handler::complete_user_reply(const http::server::request &req,
+                                                        http::server::reply &rep) const {
     if (rep.status == reply::status_type::undefined)
         rep.status = reply::status_type::ok;
 
     /// Set the necessary fields that haven't been set by the user handler
     if (rep.status == reply::status_type::ok) {
         /// Statuses other than OK shouldn't have the fields set in this scope
-        if (!rep.get_header("Content-Length")) {
+        if (rep.producer) {
+            // The length of a streamed body is unknown. HTTP/1.0 clients cannot decode chunks, so the end of the
+            // body is the end of the connection.
+            if (req.http_version_major == 1 && req.http_version_minor == 0)
+                rep.add_header("Connection", "Close");
+            else if (!rep.get_header("Transfer-Encoding"))
+                rep.add_header("Transfer-Encoding", "chunked");
+        } else if (!rep.get_header("Content-Length")) {
             rep.add_header("Content-Length", std::to_string(rep.content.size()));
         }
         if (!rep.get_header("Content-Type")) {
             rep.add_header("Content-Type", "text/plain");
         }
-        if (!rep.get_header("Content-Encoding")) {
+        if (!rep.get_header("Content-Encoding") && !rep.producer) {
             handle_compression(req, rep);
         }
         auto header = rep.get_header("Connection");
-        if (!header || uppercase(header->value) == "KEEP-ALIVE") {
+        if (!header) {
             rep.add_header("Connection", "Keep-Alive");
-        } else if (header && uppercase(header->value) == "CLOSE") {
-            rep.add_header("Connection", "Close");
+        } else if (iequals(header->value, "keep-alive")) {
+            header->value = "Keep-Alive";
+        } else if (iequals(header->value, "close")) {
+            header->value = "Close";
         }
     }
 }
@@ -80,7 +109,7 @@ std::pair<bool, std::string>
 http::server::request_handler::handle_compression_for_files(const http::server::request &req, http::server::reply &rep,
                                                             const std::string &full_uncompressed_path) const {
     if (can_gzip(req)) {
-        auto file_name = req.uri.substr(req.uri.find_last_of('/') + 1);
+        auto file_name = req.uri.substr(req.uri.find_last_of('/') + 1).to_string();
         auto compressed_path = compression_folder_ + "/gzip." + file_name;
         auto temp_compressed_path = compressed_path + ".tmp";
 
@@ -126,14 +155,14 @@ http::server::request_handler::handle_compression_for_files(const http::server::
     return std::make_pair(false, "");
 }
 
-bool http::server::request_handler::url_decode(const std::string &in, std::string &out) {
+bool http::server::request_handler::url_decode(boost::string_view in, std::string &out) {
     out.clear();
     out.reserve(in.size());
     for (std::size_t i = 0; i < in.size(); ++i) {
         if (in[i] == '%') {
             if (i + 3 <= in.size()) {
                 int value = 0;
-                std::istringstream is(in.substr(i + 1, 2));
+                std::istringstream is(in.substr(i + 1, 2).to_string());
                 if (is >> std::hex >> value) {
                     out += static_cast<char>(value);
                     i += 2;
@@ -158,13 +187,13 @@ bool http::server::request_handler::can_gzip(const http::server::request &req) {
     // Safari on both OS X and iOS has problems handling compression
     bool is_safari = false;
 
-    if (auto encoding_header = req.get_header("Accept-Encoding")) {
-        if (encoding_header->value.find("gzip") != std::string::npos) {
+    if (auto encoding_header = req.get_header(known_header::accept_encoding)) {
+        if (encoding_header->value.find("gzip") != boost::string_view::npos) {
             accepts_gzip = false;
         }
     }
-    if (auto user_agent = req.get_header("User-Agent")) {
-        if (user_agent->value.find("AppleWebKit") != std::string::npos) {
+    if (auto user_agent = req.get_header(known_header::user_agent)) {
+        if (user_agent->value.find("AppleWebKit") != boost::string_view::npos) {
             is_safari = true;
         }
     }
@@ -177,7 +206,7 @@ template <>
 void http::server::request_handler::add_file<http::server::request_handler::protocol_type::http>(
     reply &rep, const std::string &full_path) const {
     try {
-        rep.sendfile.fd = file_descriptor_cache::get(full_path, O_RDONLY);
+        rep.sendfile.fd = file_descriptors_.get(full_path, O_RDONLY);
         rep.status = reply::status_type::ok;
     } catch (const std::logic_error &) {
         rep = reply::stock_reply(reply::status_type::not_found);
@@ -189,7 +218,7 @@ template <>
 void http::server::request_handler::add_file<http::server::request_handler::protocol_type::https>(
     reply &rep, const std::string &full_path) const {
     try {
-        rep.memory_mapping = char_memory_mapping_cache::get(full_path, O_RDONLY);
+        rep.memory_mapping = memory_mappings_.get(full_path, O_RDONLY);
         // Fill out the reply to be sent to the client.
         rep.status = reply::status_type::ok;
     } catch (const std::system_error &) {
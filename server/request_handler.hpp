@@ -12,6 +12,7 @@
 #ifndef HTTP_SERVER3_REQUEST_HANDLER_HPP
 #define HTTP_SERVER3_REQUEST_HANDLER_HPP
 
+#include "blocking_pool.hpp"
 #include "char_memory_mapping_cache.hpp"
 #include "file_descriptor_cache.hpp"
 #include "memory_mapping.hpp"
@@ -21,9 +22,12 @@
 #include "sendfile_op.hpp"
 #include "string_utils.hpp"
 #include "user_handler.hpp"
+#include <atomic>
+#include <boost/asio/io_service.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/noncopyable.hpp>
 #include <fstream>
+#include <memory>
 #include <string>
 
 namespace http {
@@ -34,26 +38,76 @@ class request_handler : private boost::noncopyable {
     public:
     enum protocol_type { http, https };
 
-    /// Construct with a directory containing files to be served.
+    /// Construct with a directory containing files to be served. Blocking user handlers run on the
+    /// given pool, or inline if there is none. A handler that is not shared between io threads keeps
+    /// its file caches unlocked. The user handlers are only read, so they may be shared either way.
     explicit request_handler(const std::string &doc_root, const std::string &compression_folder,
-                             const std::vector<user_handler> &user_handlers);
+                             const std::vector<user_handler> &user_handlers, blocking_pool *offload = nullptr,
+                             bool shared = true);
 
-    /// Handle a request and produce a reply.
+    /// The user handler a request goes to, or nullptr if it goes to the static files.
+    const user_handler *get_user_handler(const request &req) const;
+
+    /// Ask the user handler of a request whether its body is wanted, before it is read. Returns false with the
+    /// complete reply to send instead in rep.
+    bool accepts_body(const user_handler *handler, const request &req, reply &rep) const;
+
+    /// Handle a request and produce a reply. Asynchronous user handlers need the overload below: their requests
+    /// get a 500 Internal Server Error.
     template <protocol_type protocol> void handle_request(request &req, reply &rep) const {
-        if (auto handler = get_user_handler(req))
+        auto handler = get_user_handler(req);
+        if (handler && handler->is_async())
+            rep = reply::stock_reply(reply::status_type::internal_server_error);
+        else if (handler)
+            invoke_user_handler(req, rep, handler);
+        else
+            handle_request_internally<protocol>(req, rep);
+    }
+
+    /// Handle a request and produce a reply. Returns true if the reply is complete. Returns false if the request
+    /// went to a blocking user handler on the blocking pool, or to an asynchronous user handler; done is then
+    /// posted to io_service once the reply is complete, and the request and reply must stay untouched until it runs.
+    template <protocol_type protocol, typename Handler>
+    bool handle_request(request &req, reply &rep, boost::asio::io_service &io_service, Handler done) const {
+        auto handler = get_user_handler(req);
+        if (handler && handler->is_async()) {
+            // The completion may be called from any thread, so the headers are completed on the io thread.
+            auto completed = std::make_shared<std::atomic<bool>>(false);
+            handler->invoke(req, rep, [this, &req, &rep, &io_service, done, completed]() {
+                if (completed->exchange(true))
+                    return;
+                io_service.post([this, &req, &rep, done]() {
+                    complete_user_reply(req, rep);
+                    done();
+                });
+            });
+            return false;
+        }
+
+        if (handler && handler->is_blocking() && offload_ && offload_->size()) {
+            offload_->submit([this, &req, &rep, &io_service, handler, done]() {
+                invoke_user_handler(req, rep, handler);
+                io_service.post(done);
+            });
+            return false;
+        }
+
+        if (handler)
             invoke_user_handler(req, rep, handler);
         else
             handle_request_internally<protocol>(req, rep);
+        return true;
     }
 
     private:
     /// The directory containing the files to be served.
     std::string doc_root_, compression_folder_;
     const std::vector<user_handler> &user_handlers_;
+    blocking_pool *offload_;
 
-    /// Checks all the user handlers and returns false if there is none or true if there is. Also, if it
-    /// return strue, the second argument will contain the user handler
-    const user_handler *get_user_handler(const request &req) const;
+    /// The files being served over HTTP and HTTPS.
+    mutable file_descriptor_cache file_descriptors_;
+    mutable char_memory_mapping_cache memory_mappings_;
 
     /// Processes the request and returns either a stock resposne or a file
     template <protocol_type> void add_file(reply &rep, const std::string &full_path) const;
@@ -100,10 +154,10 @@ class request_handler : private boost::noncopyable {
             }
             rep.add_header("Content-Type", mime_types::get_mime_type(full_path));
 
-            auto header = req.get_header("Connection");
-            if (!header || http::server::uppercase(header->value) == "KEEP-ALIVE") {
+            auto header = req.get_header(known_header::connection);
+            if (!header || iequals(header->value, "keep-alive")) {
                 rep.add_header("Connection", "Keep-Alive");
-            } else if (header && uppercase(header->value) == "CLOSE") {
+            } else if (header && iequals(header->value, "close")) {
                 rep.add_header("Connection", "Close");
             }
         }
@@ -112,6 +166,9 @@ class request_handler : private boost::noncopyable {
     /// Invokes the user handler and fixes the missing headers
     void invoke_user_handler(request &req, reply &rep, const user_handler *u_handler) const;
 
+    /// Fixes the missing headers of a reply filled in by a user handler
+    void complete_user_reply(const request &req, reply &rep) const;
+
     /// Compression handling functions. Decide if a response can be compressed, compress it and
     /// update the response headers
     void handle_compression(const http::server::request &req, http::server::reply &rep) const;
@@ -124,7 +181,7 @@ class request_handler : private boost::noncopyable {
 
     /// Perform URL-decoding on a string. Returns false if the encoding was
     /// invalid.
-    static bool url_decode(const std::string &in, std::string &out);
+    static bool url_decode(boost::string_view in, std::string &out);
 
     static bool can_gzip(const request &req);
 };
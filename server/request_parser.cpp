@@ -9,18 +9,218 @@
 //
 
 #include "request_parser.hpp"
-http::server::request_parser::request_parser() : state_(method_start) {}
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#include <tmmintrin.h>
+#endif
 
-void http::server::request_parser::reset() { state_ = method_start; }
+namespace {
+/// The characters allowed in the method and in header names, the ones that are neither control characters nor
+/// tspecials, as a bitmap indexed by the two halves of a byte: c is allowed if token_low[c & 15] has bit c >> 4
+/// set. This is the form a byte shuffle can look up 16 or 32 bytes at a time.
+alignas(16) const unsigned char token_low[16] = {0xe8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc,
+                                                 0xf8, 0xf8, 0xf4, 0x54, 0xd0, 0x54, 0xf4, 0x70};
+alignas(16) const unsigned char token_high[16] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                                                  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
-boost::logic::tribool http::server::request_parser::consume(http::server::request &req, char input) {
+inline bool is_token_char(unsigned char c) { return token_low[c & 15] & token_high[c >> 4]; }
+
+/// The URI ends at a space; it and header values may not contain control characters.
+inline bool is_uri_end(unsigned char c) { return c <= ' ' || c == 127; }
+
+inline bool is_value_end(unsigned char c) { return c < ' ' || c == 127; }
+
+/// Extend a view to end, or start it at begin if it is empty. The bytes of a view are always contiguous.
+inline void extend(boost::string_view &view, const char *begin, const char *end) {
+    view = view.empty() ? boost::string_view(begin, end - begin) : boost::string_view(view.data(), end - view.data());
+}
+
+#if defined(__SSE4_2__) && !defined(__AVX2__)
+/// The ranges of bytes ending a URI and a header value, for _mm_cmpestri.
+alignas(16) const char uri_end_ranges[16] = {'\x00', ' ', '\x7f', '\x7f'};
+alignas(16) const char value_end_ranges[16] = {'\x00', '\x1f', '\x7f', '\x7f'};
+
+constexpr int ranges_mode = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT;
+#endif
+
+/// The first byte of [p, end) that is not a token character, or end.
+const char *find_token_end(const char *p, const char *end) {
+#if defined(__AVX2__)
+    const auto low = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(token_low)));
+    const auto high = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(token_high)));
+    const auto nibble = _mm256_set1_epi8(0x0f);
+    for (; end - p >= 32; p += 32) {
+        auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        auto bits = _mm256_and_si256(_mm256_shuffle_epi8(low, _mm256_and_si256(bytes, nibble)),
+                                     _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble)));
+        auto mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bits, _mm256_setzero_si256()));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#elif defined(__SSE4_2__)
+    const auto low = _mm_load_si128(reinterpret_cast<const __m128i *>(token_low));
+    const auto high = _mm_load_si128(reinterpret_cast<const __m128i *>(token_high));
+    const auto nibble = _mm_set1_epi8(0x0f);
+    for (; end - p >= 16; p += 16) {
+        auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        auto bits = _mm_and_si128(_mm_shuffle_epi8(low, _mm_and_si128(bytes, nibble)),
+                                  _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble)));
+        auto mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128()));
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#endif
+    while (p != end && is_token_char(*p))
+        ++p;
+    return p;
+}
+
+/// The first byte of [p, end) that ends a URI, or end.
+const char *find_uri_end(const char *p, const char *end) {
+#if defined(__AVX2__)
+    const auto space = _mm256_set1_epi8(' ');
+    const auto del = _mm256_set1_epi8(127);
+    for (; end - p >= 32; p += 32) {
+        auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        auto ends = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(bytes, space), bytes),
+                                    _mm256_cmpeq_epi8(bytes, del));
+        auto mask = _mm256_movemask_epi8(ends);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#elif defined(__SSE4_2__)
+    const auto ranges = _mm_load_si128(reinterpret_cast<const __m128i *>(uri_end_ranges));
+    for (; end - p >= 16; p += 16) {
+        int i = _mm_cmpestri(ranges, 4, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), 16, ranges_mode);
+        if (i != 16)
+            return p + i;
+    }
+#endif
+    while (p != end && !is_uri_end(*p))
+        ++p;
+    return p;
+}
+
+/// The first byte of [p, end) that ends a header value, or end.
+const char *find_value_end(const char *p, const char *end) {
+#if defined(__AVX2__)
+    const auto control = _mm256_set1_epi8(' ' - 1);
+    const auto del = _mm256_set1_epi8(127);
+    for (; end - p >= 32; p += 32) {
+        auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        auto ends = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(bytes, control), bytes),
+                                    _mm256_cmpeq_epi8(bytes, del));
+        auto mask = _mm256_movemask_epi8(ends);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+#elif defined(__SSE4_2__)
+    const auto ranges = _mm_load_si128(reinterpret_cast<const __m128i *>(value_end_ranges));
+    for (; end - p >= 16; p += 16) {
+        int i = _mm_cmpestri(ranges, 4, _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), 16, ranges_mode);
+        if (i != 16)
+            return p + i;
+    }
+#endif
+    while (p != end && !is_value_end(*p))
+        ++p;
+    return p;
+}
+}
+
+http::server::request_parser::request_parser()
+    : state_(method_start), max_request_line_size_(0), max_header_size_(0), max_header_count_(0), size_(0),
+      request_line_size_(0), error_(error::none) {}
+
+void http::server::request_parser::reset() {
+    state_ = method_start;
+    size_ = request_line_size_ = 0;
+    error_ = error::none;
+}
+
+void http::server::request_parser::limit(std::size_t request_line_size, std::size_t header_size,
+                                         std::size_t header_count) {
+    max_request_line_size_ = request_line_size;
+    max_header_size_ = header_size;
+    max_header_count_ = header_count;
+}
+
+boost::tuple<boost::tribool, char *> http::server::request_parser::parse(http::server::request &req, char *begin,
+                                                                         char *end) {
+    const char *start = begin;
+    boost::tribool result = boost::indeterminate;
+    while (begin != end) {
+        // Inside a run of characters that are only stored, skip to its end. Whatever ends it, a delimiter or an
+        // invalid byte, goes through consume() like every byte outside the runs.
+        char *run_end = begin;
+        switch (state_) {
+        case method:
+            run_end += find_token_end(begin, end) - begin;
+            extend(req.method, begin, run_end);
+            break;
+        case uri:
+            run_end += find_uri_end(begin, end) - begin;
+            extend(req.uri, begin, run_end);
+            break;
+        case header_name:
+            run_end += find_token_end(begin, end) - begin;
+            extend(req.headers.back().name, begin, run_end);
+            break;
+        case header_value:
+            run_end += find_value_end(begin, end) - begin;
+            extend(req.headers.back().value, begin, run_end);
+            break;
+        default:
+            break;
+        }
+        begin = run_end;
+        if (begin != end)
+            result = consume(req, begin++);
+
+        // The limits are checked after every run, so a request going over one is never buffered much further.
+        if (!result)
+            error_ = error::malformed;
+        else if (!within_limits(req, size_ + (begin - start)))
+            result = false;
+        if (result || !result)
+            break;
+    }
+    size_ += begin - start;
+    return boost::make_tuple(result, begin);
+}
+
+bool http::server::request_parser::within_limits(const http::server::request &req, std::size_t size) {
+    if (state_ <= expecting_newline_1) {
+        request_line_size_ = size;
+        if (max_request_line_size_ && size > max_request_line_size_) {
+            error_ = error::request_line_too_long;
+            return false;
+        }
+        return true;
+    }
+    if (max_header_count_ && req.headers.size() > max_header_count_) {
+        error_ = error::too_many_headers;
+        return false;
+    }
+    if (max_header_size_ && size - request_line_size_ > max_header_size_) {
+        error_ = error::header_too_large;
+        return false;
+    }
+    return true;
+}
+
+boost::logic::tribool http::server::request_parser::consume(http::server::request &req, char *position) {
+    char input = *position;
     switch (state_) {
     case method_start:
         if (!is_char(input) || is_ctl(input) || is_tspecial(input)) {
             return false;
         } else {
             state_ = method;
-            req.method.push_back(input);
+            extend(req.method, position, position + 1);
             return boost::indeterminate;
         }
     case method:
@@ -30,7 +230,7 @@ boost::logic::tribool http::server::request_parser::consume(http::server::reques
         } else if (!is_char(input) || is_ctl(input) || is_tspecial(input)) {
             return false;
         } else {
-            req.method.push_back(input);
+            extend(req.method, position, position + 1);
             return boost::indeterminate;
         }
     case uri:
@@ -40,7 +240,7 @@ boost::logic::tribool http::server::request_parser::consume(http::server::reques
         } else if (is_ctl(input)) {
             return false;
         } else {
-            req.uri.push_back(input);
+            extend(req.uri, position, position + 1);
             return boost::indeterminate;
         }
     case http_version_h:
@@ -133,8 +333,8 @@ boost::logic::tribool http::server::request_parser::consume(http::server::reques
         } else if (!is_char(input) || is_ctl(input) || is_tspecial(input)) {
             return false;
         } else {
-            req.headers.push_back(header());
-            req.headers.back().name.push_back(input);
+            req.headers.push_back(request_header());
+            extend(req.headers.back().name, position, position + 1);
             state_ = header_name;
             return boost::indeterminate;
         }
@@ -147,18 +347,25 @@ boost::logic::tribool http::server::request_parser::consume(http::server::reques
         } else if (is_ctl(input)) {
             return false;
         } else {
+            // The value goes on over the line break, which becomes spaces, as RFC 7230 allows.
+            auto &value = req.headers.back().value;
+            if (!value.empty()) {
+                auto fold = position - value.end();
+                std::fill(position - fold, position, ' ');
+            }
             state_ = header_value;
-            req.headers.back().value.push_back(input);
+            extend(value, position, position + 1);
             return boost::indeterminate;
         }
     case header_name:
         if (input == ':') {
+            req.index_header(req.headers.size() - 1);
             state_ = space_before_header_value;
             return boost::indeterminate;
         } else if (!is_char(input) || is_ctl(input) || is_tspecial(input)) {
             return false;
         } else {
-            req.headers.back().name.push_back(input);
+            extend(req.headers.back().name, position, position + 1);
             return boost::indeterminate;
         }
     case space_before_header_value:
@@ -175,7 +382,7 @@ boost::logic::tribool http::server::request_parser::consume(http::server::reques
         } else if (is_ctl(input)) {
             return false;
         } else {
-            req.headers.back().value.push_back(input);
+            extend(req.headers.back().value, position, position + 1);
             return boost::indeterminate;
         }
     case expecting_newline_2:
@@ -14,6 +14,7 @@
 #include "request.hpp"
 #include <boost/logic/tribool.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <cstddef>
 
 namespace http {
 namespace server {
@@ -24,27 +25,36 @@ class request_parser {
     /// Construct ready to parse the request method.
     request_parser();
 
+    /// Why parsing failed.
+    enum class error { none, malformed, request_line_too_long, header_too_large, too_many_headers };
+
     /// Reset to initial parser state.
     void reset();
 
+    /// Fail requests whose request line, header fields or number of header fields are larger than the given
+    /// limits, in bytes counting line breaks, each 0 for no limit.
+    void limit(std::size_t request_line_size, std::size_t header_size, std::size_t header_count);
+
+    /// Why the last parse returned false.
+    error last_error() const { return error_; }
+
     /// Parse some data. The tribool return value is true when a complete request
     /// has been parsed, false if the data is invalid, indeterminate when more
-    /// data is required. The InputIterator return value indicates how much of the
+    /// data is required. The pointer return value indicates how much of the
     /// input has been consumed.
-    template <typename InputIterator>
-    boost::tuple<boost::tribool, InputIterator> parse(request &req, InputIterator begin, InputIterator end) {
-        while (begin != end) {
-            boost::tribool result = consume(req, *begin++);
-            if (result || !result)
-                return boost::make_tuple(result, begin);
-        }
-        boost::tribool result = boost::indeterminate;
-        return boost::make_tuple(result, begin);
-    }
+    ///
+    /// The method, the URI and the header names and values are scanned for their end many bytes at a time, with
+    /// SSE4.2 or AVX2 when the compiler targets them, and req views them where they are. A request split across
+    /// calls must therefore be contiguous: every call continues right after the end of the last one. Header
+    /// values folded over several lines are joined in place, by turning the line breaks into spaces.
+    boost::tuple<boost::tribool, char *> parse(request &req, char *begin, char *end);
 
     private:
     /// Handle the next character of input.
-    boost::tribool consume(request &req, char input);
+    boost::tribool consume(request &req, char *input);
+
+    /// Check the limits once size bytes of the request have been parsed.
+    bool within_limits(const request &req, std::size_t size);
 
     /// Check if a byte is an HTTP character.
     static bool is_char(int c);
@@ -81,6 +91,13 @@ class request_parser {
         expecting_newline_2,
         expecting_newline_3
     } state_;
+
+    std::size_t max_request_line_size_, max_header_size_, max_header_count_;
+
+    /// The bytes of the request parsed so far, and of its request line.
+    std::size_t size_, request_line_size_;
+
+    error error_;
 };
 
 } // namespace server3
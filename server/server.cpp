@@ -9,20 +9,45 @@
 //
 
 #include "server.hpp"
+#include "log.hpp"
+#include "socket_handoff.hpp"
 #include <boost/bind.hpp>
 #include <future>
 #include <stdlib.h>
 #include <string>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
 
+namespace {
+/// Sent back by the new instance of a hot restart once it accepts on the listening sockets it was handed.
+const char handoff_acknowledgement = '\x06';
+
+/// Choose HTTP/2 if the client offers it with ALPN, otherwise HTTP/1.1. Clients offering neither continue
+/// without ALPN and get HTTP/1.1.
+int select_alpn_protocol(SSL *, const unsigned char **out, unsigned char *out_length, const unsigned char *in,
+                         unsigned int in_length, void *) {
+    static const unsigned char protocols[] = "\x02h2\x08http/1.1";
+    unsigned char *selected;
+    if (::SSL_select_next_proto(&selected, out_length, protocols, sizeof(protocols) - 1, in, in_length) !=
+        OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK;
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+}
+
 http::server::server::server(const std::string &address, const std::string &http_port, const std::string &https_port,
                              const std::string &doc_root, const std::string &cert_root,
                              const std::string &compression_folder, std::size_t thread_pool_size,
-                             const std::vector<http::server::user_handler> &user_handlers)
-    : io_service_pool_(thread_pool_size), signals_(io_service_pool_.get_io_service()),
-      acceptor_(io_service_pool_.get_io_service()), ssl_acceptor_(io_service_pool_.get_io_service()), new_connection_(),
-      request_handler_(doc_root, compression_folder, user_handlers), cert_root_(cert_root),
-      ssl_context_(io_service_pool_.get_io_service(), boost::asio::ssl::context::tlsv12) {
+                             const std::vector<http::server::user_handler> &user_handlers,
+                             const http::server::server_options &options)
+    : io_service_pool_(thread_pool_size, options.affinity, options.placement),
+      signals_(io_service_pool_.get_io_service()), blocking_pool_(options.blocking_threads),
+      cert_root_(cert_root),
+      ssl_context_(io_service_pool_.get_io_service(), boost::asio::ssl::context::tlsv12), options_(options),
+      handoff_acceptor_(io_service_pool_.get_io_service(0)), handoff_socket_(io_service_pool_.get_io_service(0)),
+      handoff_reply_(0) {
 
     if (!boost::filesystem::exists(compression_folder)) {
         boost::filesystem::create_directories(compression_folder);
@@ -37,9 +62,11 @@ http::server::server::server(const std::string &address, const std::string &http
 #if defined(SIGQUIT)
     signals_.add(SIGQUIT);
 #endif // defined(SIGQUIT)
-    signals_.async_wait([this](const auto &, const auto &) { this->handle_stop(); });
+    signals_.async_wait([this](const auto &e, const auto &) {
+        if (e != boost::asio::error::operation_aborted)
+            this->handle_stop();
+    });
 
-    // Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
     boost::asio::ip::tcp::resolver resolver(io_service_pool_.get_io_service());
     boost::asio::ip::tcp::resolver::query query(address, http_port);
     boost::asio::ip::tcp::endpoint endpoint = *resolver.resolve(query);
@@ -48,15 +75,6 @@ http::server::server::server(const std::string &address, const std::string &http
     boost::asio::ip::tcp::resolver::query ssl_query(address, https_port);
     boost::asio::ip::tcp::endpoint ssl_endpoint = *ssl_resolver.resolve(ssl_query);
 
-    acceptor_.open(endpoint.protocol());
-    acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-    acceptor_.bind(endpoint);
-    acceptor_.listen();
-    ssl_acceptor_.open(ssl_endpoint.protocol());
-    ssl_acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-    ssl_acceptor_.bind(ssl_endpoint);
-    ssl_acceptor_.listen();
-
     ssl_context_.set_options(boost::asio::ssl::context::default_workarounds | boost::asio::ssl::context::no_sslv2 |
                              boost::asio::ssl::context::single_dh_use);
     ssl_context_.set_password_callback([this](std::size_t, const auto &) { return this->get_password(); });
@@ -64,42 +82,172 @@ http::server::server::server(const std::string &address, const std::string &http
     ssl_context_.use_certificate_chain_file(cert_folder + "/server.crt");
     ssl_context_.use_private_key_file(cert_folder + "/server.key", boost::asio::ssl::context::pem);
     ssl_context_.use_tmp_dh_file(cert_folder + "/dh2048.pem");
+    if (options_.http2)
+        ::SSL_CTX_set_alpn_select_cb(ssl_context_.native_handle(), select_alpn_protocol, nullptr);
+
+    // In shared-nothing mode every io_service gets its own request handler, whose caches are then only used by
+    // that io_service's thread and need no locking. The user handlers stay shared: they are only read.
+    std::size_t handler_count = options_.shared_nothing ? io_service_pool_.size() : 1;
+    for (std::size_t i = 0; i < handler_count; ++i)
+        request_handlers_.emplace_back(new request_handler(doc_root, compression_folder, user_handlers,
+                                                           &blocking_pool_, !options_.shared_nothing));
+    auto select_handler = [this](worker &w) -> request_handler & {
+        return *request_handlers_[options_.shared_nothing ? w.index : 0];
+    };
+
+    if (options_.reuse_port) {
+        // One listener per io_service, each accepting connections for its own thread only.
+        for (std::size_t i = 0; i < io_service_pool_.size(); ++i) {
+            auto &w = io_service_pool_.get_worker(i);
+            auto select = [&w]() -> worker & { return w; };
+            listeners_.emplace_back(
+                new listener(w.io_service, select, select_handler, ssl_context_, options_, metrics_));
+        }
+    } else {
+        auto select = [this]() -> worker & { return io_service_pool_.get_worker(); };
+        listeners_.emplace_back(new listener(io_service_pool_.get_io_service(0), select, select_handler,
+                                             ssl_context_, options_, metrics_));
+    }
 
-    start_accept();
-    start_ssl_accept();
+    // Listening sockets inherited from a previous instance come in HTTP/HTTPS pairs, one per listener.
+    // Listeners without a pair bind their own; unused inherited sockets are closed.
+    std::vector<int> inherited = take_over_listeners();
+    for (std::size_t i = 0; i < listeners_.size(); ++i) {
+        if (2 * i + 1 < inherited.size()) {
+            listeners_[i]->adopt(endpoint, ssl_endpoint, inherited[2 * i], inherited[2 * i + 1]);
+        } else {
+            int incoming_cpu = options_.reuse_port ? io_service_pool_.get_cpu(i) : -1;
+            listeners_[i]->listen(endpoint, ssl_endpoint, options_.reuse_port, incoming_cpu);
+        }
+        listeners_[i]->start();
+    }
+    for (std::size_t i = 2 * listeners_.size(); i < inherited.size(); ++i)
+        ::close(inherited[i]);
+
+    if (handoff_socket_.is_open()) {
+        // The previous instance keeps serving until it knows the sockets are in use here.
+        boost::system::error_code ec;
+        boost::asio::write(handoff_socket_, boost::asio::buffer(&handoff_acknowledgement, 1), ec);
+        if (ec)
+            log::write("server: could not acknowledge the handoff: " + ec.message());
+        handoff_socket_.close(ec);
+    }
+    start_handoff_accept();
 }
 
 void http::server::server::run() { io_service_pool_.run(); }
 
-void http::server::server::start_accept() {
-    new_connection_.reset(new connection(io_service_pool_.get_io_service(), request_handler_));
-    acceptor_.async_accept(new_connection_->socket(), [this](const auto &e) { this->handle_accept(e); });
+std::string http::server::server::get_cert_folder() const { return cert_root_; }
+
+std::string http::server::server::get_password() const { return "test"; }
+
+void http::server::server::handle_stop() {
+    if (handoff_acceptor_.is_open()) {
+        handoff_acceptor_.close();
+        ::unlink(options_.handoff_path.c_str());
+    }
+    io_service_pool_.stop();
+}
+
+std::vector<int> http::server::server::take_over_listeners() {
+    if (options_.handoff_path.empty())
+        return {};
+
+    // The socket stays connected until the listeners have started, then carries the acknowledgement. If this
+    // instance fails before that, the previous one sees it closed and keeps serving.
+    auto &s = handoff_socket_;
+    boost::system::error_code ec;
+    s.connect(boost::asio::local::stream_protocol::endpoint(options_.handoff_path), ec);
+    if (ec) {
+        s.close(ec);
+        return {}; // Nobody to take over from.
+    }
+    if (!socket_handoff::is_trusted_peer(s.native_handle())) {
+        log::write("server: the handoff socket belongs to another user, not taking its listening sockets");
+        s.close(ec);
+        return {};
+    }
+
+    auto descriptors = socket_handoff::receive_descriptors(s.native_handle());
+    log::write("server: took over " + std::to_string(descriptors.size()) + " listening sockets");
+    return descriptors;
 }
 
-void http::server::server::start_ssl_accept() {
-    new_ssl_connection_.reset(new ssl_connection(io_service_pool_.get_io_service(), ssl_context_, request_handler_));
-    ssl_acceptor_.async_accept(new_ssl_connection_->lowest_layer__socket(),
-                               [this](const auto &e) { this->handle_ssl_accept(e); });
+void http::server::server::start_handoff_accept() {
+    if (options_.handoff_path.empty())
+        return;
+
+    if (!handoff_acceptor_.is_open()) {
+        // The previous instance, if any, has already handed over and no longer accepts on the path.
+        ::unlink(options_.handoff_path.c_str());
+        boost::asio::local::stream_protocol::endpoint endpoint(options_.handoff_path);
+        handoff_acceptor_.open(endpoint.protocol());
+        handoff_acceptor_.bind(endpoint);
+        // Only the owner may connect. Nobody can have connected yet, the acceptor is not listening.
+        ::chmod(options_.handoff_path.c_str(), S_IRUSR | S_IWUSR);
+        handoff_acceptor_.listen();
+    }
+    handoff_acceptor_.async_accept(handoff_socket_, [this](const auto &e) { this->handle_handoff_accept(e); });
 }
 
-void http::server::server::handle_accept(const boost::system::error_code &e) {
-    if (!e) {
-        new_connection_->start();
+void http::server::server::handle_handoff_accept(const boost::system::error_code &e) {
+    if (!handoff_acceptor_.is_open())
+        return;
+    if (e) {
+        start_handoff_accept();
+        return;
+    }
+
+    if (!socket_handoff::is_trusted_peer(handoff_socket_.native_handle())) {
+        log::write("server: refused to hand the listening sockets over to a process of another user");
+        handoff_socket_.close();
+        start_handoff_accept();
+        return;
     }
 
-    start_accept();
+    std::vector<int> descriptors;
+    for (auto &l : listeners_) {
+        auto handles = l->native_handles();
+        descriptors.insert(descriptors.end(), handles.begin(), handles.end());
+    }
+    try {
+        socket_handoff::send_descriptors(handoff_socket_.native_handle(), descriptors);
+    } catch (const std::exception &ex) {
+        log::write(std::string("server: hot restart handoff failed: ") + ex.what());
+        handoff_socket_.close();
+        start_handoff_accept();
+        return;
+    }
+
+    boost::asio::async_read(handoff_socket_, boost::asio::buffer(&handoff_reply_, 1),
+                            [this](const auto &e, std::size_t) { this->handle_handoff_reply(e); });
 }
 
-void http::server::server::handle_ssl_accept(const boost::system::error_code &e) {
-    if (!e) {
-        new_ssl_connection_->start();
+void http::server::server::handle_handoff_reply(const boost::system::error_code &e) {
+    boost::system::error_code ignored_ec;
+    handoff_socket_.close(ignored_ec);
+    if (!handoff_acceptor_.is_open())
+        return;
+    if (e || handoff_reply_ != handoff_acknowledgement) {
+        log::write("server: the next instance did not take the listening sockets over, still serving");
+        start_handoff_accept();
+        return;
     }
 
-    start_ssl_accept();
+    log::write("server: handed the listening sockets over, draining");
+    // The path now belongs to the new instance, so it must not be unlinked.
+    handoff_acceptor_.close();
+    drain();
 }
 
-std::string http::server::server::get_cert_folder() const { return cert_root_; }
+void http::server::server::drain() {
+    for (auto &l : listeners_)
+        l->stop();
 
-std::string http::server::server::get_password() const { return "test"; }
+    // Restore the default signal dispositions so that the draining process can still be terminated.
+    boost::system::error_code ignored_ec;
+    signals_.cancel(ignored_ec);
+    signals_.clear(ignored_ec);
 
-void http::server::server::handle_stop() { io_service_pool_.stop(); }
+    io_service_pool_.drain();
+}
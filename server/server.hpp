@@ -11,8 +11,11 @@
 #ifndef HTTP_SERVER3_SERVER_HPP
 #define HTTP_SERVER3_SERVER_HPP
 
+#include "blocking_pool.hpp"
 #include "io_service_pool.hpp"
+#include "listener.hpp"
 #include "request_handler.hpp"
+#include "server_options.hpp"
 #include "ssl_connection.hpp"
 #include <boost/asio.hpp>
 #include <boost/noncopyable.hpp>
@@ -28,22 +31,16 @@ class server : private boost::noncopyable {
     /// serve up files from the given directory.
     explicit server(const std::string &address, const std::string &http_port, const std::string &https_port,
                     const std::string &doc_root, const std::string &cert_root, const std::string &compression_folder,
-                    std::size_t thread_pool_size, const std::vector<user_handler> &user_handlers);
+                    std::size_t thread_pool_size, const std::vector<user_handler> &user_handlers,
+                    const server_options &options = server_options());
 
     /// Run the server's io_service loop.
     void run();
 
-    private:
-    /// Initiate an asynchronous accept operation.
-    void start_accept();
-
-    void start_ssl_accept();
-
-    /// Handle completion of an asynchronous accept operation.
-    void handle_accept(const boost::system::error_code &e);
-
-    void handle_ssl_accept(const boost::system::error_code &e);
+    /// Counters of the server's activity.
+    const server_metrics &metrics() const { return metrics_; }
 
+    private:
     std::string get_cert_folder() const;
 
     std::string get_compression_folder() const;
@@ -53,22 +50,35 @@ class server : private boost::noncopyable {
     /// Handle a request to stop the server.
     void handle_stop();
 
+    /// Get the listening sockets of the instance serving options_.handoff_path, if there is one.
+    std::vector<int> take_over_listeners();
+
+    /// Listen on options_.handoff_path for the next instance of the server.
+    void start_handoff_accept();
+
+    /// Hand the listening sockets to the next instance and wait for it to acknowledge them.
+    void handle_handoff_accept(const boost::system::error_code &e);
+
+    /// Drain once the next instance has acknowledged the listening sockets, or keep serving if it failed.
+    void handle_handoff_reply(const boost::system::error_code &e);
+
+    /// Stop accepting and let the open connections finish.
+    void drain();
+
+    server_metrics metrics_;
+
     /// The pool of io_service objects used to perform asynchronous operations.
     io_service_pool io_service_pool_;
 
     /// The signal_set is used to register for process termination notifications.
     boost::asio::signal_set signals_;
 
-    /// Acceptors used to listen for incoming connectionss.
-    boost::asio::ip::tcp::acceptor acceptor_;
-    boost::asio::ip::tcp::acceptor ssl_acceptor_;
-
-    /// The next connection to be accepted.
-    connection_ptr new_connection_;
-    ssl_connection_ptr new_ssl_connection_;
+    /// The pool running the blocking user handlers.
+    blocking_pool blocking_pool_;
 
-    /// The handler for all incoming requests.
-    request_handler request_handler_;
+    /// The handlers for all incoming requests: a single one shared by all the io_services, or one per
+    /// io_service in shared-nothing mode.
+    std::vector<std::unique_ptr<request_handler>> request_handlers_;
 
     /// The folder containing the certificate files. Must have the following files:
     /// server.crt
@@ -79,6 +89,20 @@ class server : private boost::noncopyable {
 
     /// The SSL context
     boost::asio::ssl::context ssl_context_;
+
+    server_options options_;
+
+    /// Listeners used to accept incoming connections. There is a single one unless
+    /// options_.reuse_port is set, in which case every io_service has its own.
+    std::vector<std::unique_ptr<listener>> listeners_;
+
+    /// Accepts the next instance of the server during a hot restart. The socket is connected to the next instance
+    /// while handing over, or to the previous one while taking over.
+    boost::asio::local::stream_protocol::acceptor handoff_acceptor_;
+    boost::asio::local::stream_protocol::socket handoff_socket_;
+
+    /// What the next instance replied once it had the listening sockets.
+    char handoff_reply_;
 };
 
 } // namespace server3
@@ -18,13 +18,33 @@ QMAKE_CXXFLAGS_RELEASE += -s -O3 -flto
 QMAKE_LFLAGS_RELEASE -= -O1
 QMAKE_LFLAGS_RELEASE += -O3 -flto -std=c++14
 
+# Build with "qmake CONFIG+=io_uring" to run every io_service on Asio's io_uring backend instead of
+# epoll. Requires Boost 1.78 or newer and liburing, and must be set for the library and its users alike.
+io_uring {
+    DEFINES += THOR_HAS_IO_URING BOOST_ASIO_HAS_IO_URING BOOST_ASIO_DISABLE_EPOLL
+    LIBS += -luring
+}
+
+# Build with "qmake CONFIG+=native" to compile for the instruction sets of the build machine, which enables the
+# SSE4.2 or AVX2 scanning of the request parser. The binary then only runs on machines that have them.
+native {
+    QMAKE_CXXFLAGS += -march=native
+}
+
 SOURCES += server.cpp \
+    blocking_pool.cpp \
     char_memory_mapping_cache.cpp \
+    chunked_parser.cpp \
     connection.cpp \
+    connection_pool.cpp \
+    cpu_affinity.cpp \
     file_descriptor_cache.cpp \
     file_descriptor.cpp \
     header.cpp \
+    hpack.cpp \
+    http2_session.cpp \
     io_service_pool.cpp \
+    listener.cpp \
     memory_mapping.cpp \
     mime_types.cpp \
     reply.cpp \
@@ -32,19 +52,29 @@ SOURCES += server.cpp \
     request_parser.cpp \
     request.cpp \
     sendfile_op.cpp \
+    socket_handoff.cpp \
     ssl_connection.cpp \
     string_utils.cpp \
+    timing_wheel.cpp \
     user_handler.cpp \
     log.cpp
 
 HEADERS += \
     thor.hpp \
+    blocking_pool.hpp \
     char_memory_mapping_cache.hpp \
+    chunked_parser.hpp \
     connection.hpp \
+    connection_pool.hpp \
+    cpu_affinity.hpp \
     file_descriptor_cache.hpp \
     file_descriptor.hpp \
+    handler_memory.hpp \
     header.hpp \
+    hpack.hpp \
+    http2_session.hpp \
     io_service_pool.hpp \
+    listener.hpp \
     memory_mapping.hpp \
     mime_types.hpp \
     reply.hpp \
@@ -53,9 +83,14 @@ HEADERS += \
     request.hpp \
     sendfile_op.hpp \
     server.hpp \
+    server_metrics.hpp \
+    server_options.hpp \
     ssl_connection.hpp \
+    socket_handoff.hpp \
     string_utils.hpp \
+    timing_wheel.hpp \
     user_handler.hpp \
+    worker.hpp \
     log.hpp
 
 unix {
@@ -0,0 +1,43 @@
+//
+// server_metrics.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef SERVER_METRICS_HPP
+#define SERVER_METRICS_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace http {
+namespace server {
+
+/// Counters describing what the server has done since it started. They are updated by the io threads and
+/// may be read from any thread.
+struct server_metrics {
+    /// Connections accepted on all listeners.
+    std::atomic<std::uint64_t> accepted{0};
+
+    /// Wakeups of the batched accept loop that accepted at least one connection. accepted / accept_batches
+    /// is the average burst size.
+    std::atomic<std::uint64_t> accept_batches{0};
+
+    /// The most connections accepted in a single batch.
+    std::atomic<std::uint64_t> largest_accept_batch{0};
+
+    /// Connections turned away because the server had reached server_options::max_connections.
+    std::atomic<std::uint64_t> rejected_by_global_limit{0};
+
+    /// Connections turned away because the worker chosen for them had reached
+    /// server_options::max_connections_per_thread.
+    std::atomic<std::uint64_t> rejected_by_thread_limit{0};
+};
+}
+}
+
+#endif // SERVER_METRICS_HPP
@@ -0,0 +1,112 @@
+//
+// server_options.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef SERVER_OPTIONS_HPP
+#define SERVER_OPTIONS_HPP
+
+#include "cpu_affinity.hpp"
+#include "io_service_pool.hpp"
+#include <cstddef>
+#include <string>
+
+namespace http {
+namespace server {
+
+/// Optional tuning knobs of the server. The defaults reproduce the behaviour of a plain server.
+struct server_options {
+    /// Give every io_service of the pool its own SO_REUSEPORT listening sockets for HTTP and HTTPS
+    /// instead of sharing one acceptor pair. The kernel then spreads incoming connections between
+    /// the threads and every connection stays on the thread that accepted it.
+    bool reuse_port = false;
+
+    /// How the threads of the io_service pool are pinned to CPUs. When threads are pinned and reuse_port
+    /// is set, every listening socket is also tagged with SO_INCOMING_CPU so that connections whose packets
+    /// arrive on a CPU are accepted by the thread running on it.
+    affinity_policy affinity;
+
+    /// How a connection accepted by the shared listener is assigned to an io_service. Not used with
+    /// reuse_port, where connections stay on the accepting thread.
+    placement_strategy placement = placement_strategy::round_robin;
+
+    /// Accept connections in batches: wait for the listening socket to become readable, then accept with
+    /// non-blocking accept4() calls until the backlog is empty. Cuts the reactor round trips per connection
+    /// during connection storms. The batch sizes are reported in server_metrics.
+    bool batch_accept = false;
+
+    /// Cork the socket (TCP_CORK) while sending the headers and the file of a sendfile reply, so that small
+    /// files leave in the same segments as their headers instead of in a packet of their own.
+    bool cork_responses = false;
+
+    /// The most connections open at once on the whole server, or 0 for no limit. Once it is reached the server is
+    /// overloaded: new HTTP connections get a canned 503 Service Unavailable reply and are closed without their
+    /// request being read or parsed, and new HTTPS connections are closed. Rejections are counted in
+    /// server_metrics.
+    std::size_t max_connections = 0;
+
+    /// The same limit for each io_service of the pool, or 0 for no limit.
+    std::size_t max_connections_per_thread = 0;
+
+    /// Give every io_service its own request handler with its own file descriptor and memory mapping caches,
+    /// so that serving a static file never takes a lock or touches a cache line written by another thread.
+    /// The user handlers and the mime table are read-only and remain shared. Files open on several threads
+    /// are opened once per thread.
+    bool shared_nothing = false;
+
+    /// The most pipelined requests handled before their replies are written. Replies of requests that arrived
+    /// together go out in one gathered write; further requests wait in the read buffer until that write is
+    /// done, and nothing more is read from the client meanwhile.
+    std::size_t pipeline_depth = 16;
+
+    /// Offer HTTP/2 to HTTPS clients with ALPN. Clients that choose it send all their requests over a single
+    /// multiplexed connection instead of opening several HTTP/1.1 connections; each stream is handled by the
+    /// request handler like an HTTPS request. Clients without ALPN or HTTP/2 support keep using HTTP/1.1.
+    bool http2 = false;
+
+    /// The most bytes a streamed reply (reply::producer) is asked for at a time. The connection asks for the next
+    /// piece only once the previous one has been handed to the socket, so this bounds the memory a streamed reply
+    /// holds, whatever its total length.
+    std::size_t stream_window = 65536;
+
+    /// The longest request body kept in request::body, or 0 for no limit. A request declaring a longer body gets a
+    /// 413 Payload Too Large reply without its body being read, and its connection is closed. Bodies delivered
+    /// to a user_handler::body_handler are not held in memory and have no limit.
+    std::size_t max_request_body_size = 0;
+
+    /// The longest request line, in bytes. A longer one gets a 414 URI Too Long reply and its connection is
+    /// closed. 0 for no limit.
+    std::size_t max_request_line_size = 8192;
+
+    /// The most bytes of header fields, and the most header fields, a request may have. A request with more gets a
+    /// 431 Request Header Fields Too Large reply and its connection is closed. 0 for no limit. Over HTTP/2 the
+    /// header block is also limited by its decoder, to 64 KiB.
+    std::size_t max_header_size = 65536;
+    std::size_t max_header_count = 100;
+
+    /// How long a client may take to send the request line and headers of a request, in seconds, from the start
+    /// of the connection for the first request and from the first byte for the next ones. A client that has not
+    /// sent them all by then gets a 408 Request Timeout reply, or nothing if it has not started a request, and
+    /// its connection is closed: a client sending its headers a byte at a time cannot hold one.
+    int header_timeout_seconds = 10;
+
+    /// Threads of the pool that runs user handlers registered as blocking. With 0, blocking handlers run
+    /// inline on the io threads like any other handler.
+    std::size_t blocking_threads = 4;
+
+    /// Path of a Unix domain socket used for zero-downtime restarts. When set, a starting server first asks the
+    /// instance listening on this path for its listening sockets and only binds new ones if there is none. It
+    /// then listens on the path itself. When the next instance connects, the server hands its listening sockets
+    /// over, stops accepting, lets its open connections finish and returns from run(). The socket is only
+    /// accessible to its owner, and sockets are only handed over between processes of the same user, or root.
+    std::string handoff_path;
+};
+}
+}
+
+#endif // SERVER_OPTIONS_HPP
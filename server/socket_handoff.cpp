@@ -0,0 +1,92 @@
+//
+// socket_handoff.cpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "socket_handoff.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <system_error>
+#include <unistd.h>
+
+void http::server::socket_handoff::send_descriptors(int unix_socket, const std::vector<int> &descriptors) {
+    if (descriptors.size() > max_descriptors)
+        throw std::length_error{"Too many descriptors to hand off"};
+
+    // The payload is the number of descriptors, so that the receiver can tell a truncated message.
+    std::uint32_t count = descriptors.size();
+    iovec iov = {&count, sizeof(count)};
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * max_descriptors));
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (count) {
+        msg.msg_control = control.data();
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        std::memcpy(CMSG_DATA(cmsg), descriptors.data(), sizeof(int) * count);
+    }
+
+    ssize_t sent;
+    do {
+        sent = ::sendmsg(unix_socket, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent != sizeof(count))
+        throw std::system_error(std::error_code(sent < 0 ? errno : EPROTO, std::system_category()));
+}
+
+std::vector<int> http::server::socket_handoff::receive_descriptors(int unix_socket) {
+    std::uint32_t count = 0;
+    iovec iov = {&count, sizeof(count)};
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * max_descriptors));
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    ssize_t received;
+    do {
+        received = ::recvmsg(unix_socket, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received < 0)
+        throw std::system_error(std::error_code(errno, std::system_category()));
+
+    std::vector<int> descriptors;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            auto n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            auto first = descriptors.size();
+            descriptors.resize(first + n);
+            std::memcpy(&descriptors[first], CMSG_DATA(cmsg), sizeof(int) * n);
+        }
+    }
+
+    if (received != sizeof(count) || descriptors.size() != count || (msg.msg_flags & MSG_CTRUNC)) {
+        for (int fd : descriptors)
+            ::close(fd);
+        throw std::system_error(std::error_code(EPROTO, std::system_category()));
+    }
+    return descriptors;
+}
+
+bool http::server::socket_handoff::is_trusted_peer(int unix_socket) {
+    ucred credentials = {};
+    socklen_t length = sizeof(credentials);
+    if (::getsockopt(unix_socket, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0)
+        return false;
+    return credentials.uid == ::geteuid() || credentials.uid == 0;
+}
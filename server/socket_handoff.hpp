@@ -0,0 +1,40 @@
+//
+// socket_handoff.hpp
+// ~~~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef SOCKET_HANDOFF_HPP
+#define SOCKET_HANDOFF_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace http {
+namespace server {
+
+/// Passing file descriptors between processes over a connected Unix domain socket (SCM_RIGHTS).
+namespace socket_handoff {
+
+/// The most descriptors sent in one handoff.
+static constexpr std::size_t max_descriptors = 256;
+
+/// Send the descriptors. Throws std::system_error on failure.
+void send_descriptors(int unix_socket, const std::vector<int> &descriptors);
+
+/// Receive descriptors sent by send_descriptors. They are close-on-exec and owned by the caller.
+/// Throws std::system_error on failure.
+std::vector<int> receive_descriptors(int unix_socket);
+
+/// Whether the process at the other end of the socket runs as the same user as this one, or as root. Listening
+/// sockets are only handed to, or taken from, such a process.
+bool is_trusted_peer(int unix_socket);
+}
+}
+}
+
+#endif // SOCKET_HANDOFF_HPP
@@ -11,6 +11,7 @@
 #ifndef SSL_CONNECTION
 #define SSL_CONNECTION
 #include "connection.hpp"
+#include "http2_session.hpp"
 #include <boost/asio/ssl.hpp>
 #include <boost/bind.hpp>
 #include <iostream>
@@ -22,38 +23,50 @@ namespace server {
 class ssl_connection : public connection {
     public:
     typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> ssl_socket;
-    /// Construct a connection with the given io_service.
-    explicit ssl_connection(boost::asio::io_service &io_service, boost::asio::ssl::context &context,
-                            request_handler &handler);
+    /// Construct a connection running on the given worker's io_service.
+    explicit ssl_connection(worker &w, boost::asio::ssl::context &context, request_handler &handler,
+                            const server_options &options);
 
     virtual ~ssl_connection();
 
-    ssl_socket::lowest_layer_type &lowest_layer__socket() { return socket_.lowest_layer(); }
+    ssl_socket::lowest_layer_type &lowest_layer__socket() { return socket_->lowest_layer(); }
 
-    /// Start the first asynchronous operation for the connection.
-    void start() override;
+    /// Get the TCP socket underneath the TLS stream.
+    boost::asio::ip::tcp::socket &socket() override { return socket_->next_layer(); }
 
-    private:
-    void sync_read(char *where, std::size_t bytes, boost::system::error_code &ec) override;
+    /// A TLS stream cannot be reused, so recycling also replaces it with a new one.
+    void recycle() override;
 
     protected:
-    virtual void start_reading(const boost::system::error_code &error = {}) override;
+    bool needs_handshake() const override { return true; }
 
-    /// Handle completion of a read operation.
-    void handle_read(const boost::system::error_code &e, std::size_t bytes_transferred) override;
+    void async_handshake(io_handler handler) override;
 
-    /// Handle completion of a write operation.
-    void handle_write(const boost::system::error_code &e) override;
+    /// Start an HTTP/2 session if the client chose "h2" with ALPN.
+    bool upgrade() override;
 
-    void handle_shutdown(const boost::system::error_code &);
+    void async_read_some(boost::asio::mutable_buffers_1 buffer, io_handler handler) override;
 
-    void print_err(boost::system::error_code error);
+    void async_write(const_buffers_view buffers, io_handler handler) override;
+
+    /// Files are served from memory mappings over TLS, so there is never a file to send.
+    bool async_sendfile(io_handler) override { return false; }
+
+    /// Request bodies are decrypted in the process, they cannot be spliced.
+    bool can_splice() const override { return false; }
 
-    boost::shared_ptr<ssl_connection> shared_from_this();
+    bool handle_request(reply &rep, io_handler handler) override;
+
+    void print_err(boost::system::error_code error);
 
     private:
+    boost::asio::ssl::context &context_;
+
     /// Socket for the connection.
-    ssl_socket socket_;
+    std::unique_ptr<ssl_socket> socket_;
+
+    /// The session serving the connection if it speaks HTTP/2.
+    std::unique_ptr<http2_session> http2_;
 };
 
 typedef boost::shared_ptr<ssl_connection> ssl_connection_ptr;
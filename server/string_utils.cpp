@@ -9,5 +9,46 @@
 //
 
 #include "string_utils.hpp"
+#include <cstdint>
+#include <limits>
 
-std::string http::server::uppercase(const std::string &str) { return uppercase(str.cbegin(), str.cend()); }
+std::string http::server::uppercase(boost::string_view str) { return uppercase(str.cbegin(), str.cend()); }
+
+namespace {
+inline char lower(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+}
+
+bool http::server::iequals(boost::string_view a, boost::string_view b) {
+    if (a.size() != b.size())
+        return false;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if (lower(a[i]) != lower(b[i]))
+            return false;
+    }
+    return true;
+}
+
+std::size_t http::server::ihash(boost::string_view str) {
+    // FNV-1a.
+    std::uint32_t hash = 2166136261u;
+    for (auto c : str) {
+        hash ^= static_cast<unsigned char>(lower(c));
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool http::server::parse_size(boost::string_view str, std::size_t &size) {
+    if (str.empty())
+        return false;
+    size = 0;
+    for (auto c : str) {
+        if (c < '0' || c > '9')
+            return false;
+        std::size_t digit = c - '0';
+        if (size > (std::numeric_limits<std::size_t>::max() - digit) / 10)
+            return false;
+        size = size * 10 + digit;
+    }
+    return true;
+}
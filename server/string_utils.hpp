@@ -10,6 +10,8 @@
 
 #ifndef STRING_UTILS_HPP
 #define STRING_UTILS_HPP
+#include <boost/utility/string_view.hpp>
+#include <cstddef>
 #include <string>
 
 namespace http {
@@ -23,7 +25,17 @@ template <typename InputIterator> inline std::string uppercase(InputIterator beg
     return out;
 }
 
-std::string uppercase(const std::string &str);
+std::string uppercase(boost::string_view str);
+
+/// Compare two strings ignoring the case of ASCII letters, as header names and most header values are compared.
+bool iequals(boost::string_view a, boost::string_view b);
+
+/// A hash of a string that ignores the case of ASCII letters, consistent with iequals.
+std::size_t ihash(boost::string_view str);
+
+/// Parse a decimal size such as the value of a Content-Length header: digits only, without a sign, spaces or
+/// overflow. Returns false if str is not one.
+bool parse_size(boost::string_view str, std::size_t &size);
 }
 }
 
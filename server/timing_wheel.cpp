@@ -0,0 +1,139 @@
+//
+// timing_wheel.cpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "timing_wheel.hpp"
+#include <algorithm>
+
+void http::server::timing_wheel::entry::cancel() {
+    if (!wheel_)
+        return;
+    unlink(*this);
+    --wheel_->size_;
+    wheel_ = nullptr;
+}
+
+http::server::timing_wheel::timing_wheel(boost::asio::io_service &io_service, clock::duration resolution)
+    : timer_(io_service), resolution_(resolution), now_(0), size_(0), running_(false) {
+    for (auto *l : {&near_, &far_}) {
+        for (auto &slot : *l)
+            slot.prev = slot.next = &slot;
+    }
+}
+
+http::server::timing_wheel::~timing_wheel() {
+    // Entries may outlive the wheel, for example connections destroyed along with their io_service.
+    for (auto *l : {&near_, &far_}) {
+        for (auto &slot : *l) {
+            while (slot.next != &slot) {
+                auto &e = static_cast<entry &>(*slot.next);
+                unlink(e);
+                e.wheel_ = nullptr;
+            }
+        }
+    }
+}
+
+void http::server::timing_wheel::arm(http::server::timing_wheel::entry &e, clock::duration timeout) {
+    e.cancel();
+    if (!running_)
+        start_timer();
+
+    auto ticks = (timeout + resolution_ - clock::duration(1)) / resolution_;
+    e.deadline_ = now_ + std::max<std::size_t>(ticks, 1);
+    e.wheel_ = this;
+    ++size_;
+    insert(e);
+}
+
+void http::server::timing_wheel::insert(http::server::timing_wheel::entry &e) {
+    auto delta = e.deadline_ - now_;
+    if (delta < level_size) {
+        link(near_[e.deadline_ & level_mask], e);
+    } else {
+        // Further away than the second level reaches: park it in the last slot the second level covers,
+        // it is put back in place when that slot is cascaded.
+        auto when = delta < level_size * level_size ? e.deadline_ : now_ + level_size * level_size - 1;
+        link(far_[(when >> level_bits) & level_mask], e);
+    }
+}
+
+void http::server::timing_wheel::link(http::server::timing_wheel::hook &head, http::server::timing_wheel::hook &h) {
+    h.prev = head.prev;
+    h.next = &head;
+    head.prev->next = &h;
+    head.prev = &h;
+}
+
+void http::server::timing_wheel::unlink(http::server::timing_wheel::hook &h) {
+    h.prev->next = h.next;
+    h.next->prev = h.prev;
+    h.prev = h.next = nullptr;
+}
+
+void http::server::timing_wheel::splice(http::server::timing_wheel::hook &slot,
+                                        http::server::timing_wheel::hook &list) {
+    list.prev = list.next = &list;
+    if (slot.next == &slot)
+        return;
+    list.next = slot.next;
+    list.prev = slot.prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    slot.prev = slot.next = &slot;
+}
+
+void http::server::timing_wheel::start_timer() {
+    running_ = true;
+    last_tick_ = clock::now();
+    timer_.expires_at(last_tick_ + resolution_);
+    timer_.async_wait([this](const boost::system::error_code &ec) { this->handle_timer(ec); });
+}
+
+void http::server::timing_wheel::handle_timer(const boost::system::error_code &ec) {
+    if (ec) {
+        running_ = false;
+        return;
+    }
+
+    // Catch up with the ticks missed while the io_service was busy.
+    auto elapsed = (clock::now() - last_tick_) / resolution_;
+    for (decltype(elapsed) i = 0; i < elapsed && size_; ++i)
+        tick();
+    last_tick_ += elapsed * resolution_;
+
+    if (!size_) {
+        running_ = false;
+        return;
+    }
+    timer_.expires_at(last_tick_ + resolution_);
+    timer_.async_wait([this](const boost::system::error_code &ec) { this->handle_timer(ec); });
+}
+
+void http::server::timing_wheel::tick() {
+    ++now_;
+
+    hook list;
+    if ((now_ & level_mask) == 0) {
+        splice(far_[(now_ >> level_bits) & level_mask], list);
+        while (list.next != &list) {
+            auto &e = static_cast<entry &>(*list.next);
+            unlink(e);
+            insert(e);
+        }
+    }
+
+    // The callbacks may arm or cancel any entry, including the ones still waiting in the list.
+    splice(near_[now_ & level_mask], list);
+    while (list.next != &list) {
+        auto &e = static_cast<entry &>(*list.next);
+        e.cancel();
+        e.on_expiry_();
+    }
+}
@@ -0,0 +1,115 @@
+//
+// timing_wheel.hpp
+// ~~~~~~~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef TIMING_WHEEL_HPP
+#define TIMING_WHEEL_HPP
+
+#include <array>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/noncopyable.hpp>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+
+namespace http {
+namespace server {
+
+/// Coarse timeouts for all the connections of one io_service, driven by a single timer.
+///
+/// Arming and cancelling a timeout is O(1) and never allocates: the entries are intrusive list nodes
+/// owned by the caller, kept in one of two levels of slots. The first level holds the timeouts due within
+/// the next level_size ticks; the second level holds later ones, level_size ticks per slot, and is
+/// cascaded into the first as time advances. The timer only runs while timeouts are armed, so an idle
+/// wheel does not keep its io_service busy.
+///
+/// Not thread safe: use it from the thread running the io_service only.
+class timing_wheel : private boost::noncopyable {
+    struct hook {
+        hook *prev = nullptr;
+        hook *next = nullptr;
+    };
+
+    public:
+    typedef std::chrono::steady_clock clock;
+
+    /// A timeout that can be armed on a wheel. The callback is called from the io_service when the
+    /// timeout expires. Destroying an armed entry cancels it.
+    class entry : private hook, private boost::noncopyable {
+        public:
+        explicit entry(std::function<void()> on_expiry) : on_expiry_(std::move(on_expiry)) {}
+
+        ~entry() { cancel(); }
+
+        bool armed() const { return wheel_ != nullptr; }
+
+        void cancel();
+
+        private:
+        friend class timing_wheel;
+
+        std::function<void()> on_expiry_;
+        timing_wheel *wheel_ = nullptr;
+        std::size_t deadline_ = 0;
+    };
+
+    /// Construct a wheel whose timeouts are rounded up to a multiple of resolution.
+    explicit timing_wheel(boost::asio::io_service &io_service,
+                          clock::duration resolution = std::chrono::seconds(1));
+
+    ~timing_wheel();
+
+    /// Arm the entry to expire after timeout, replacing any timeout it already had.
+    void arm(entry &e, clock::duration timeout);
+
+    /// The number of armed entries.
+    std::size_t size() const { return size_; }
+
+    private:
+    static constexpr std::size_t level_bits = 6;
+    static constexpr std::size_t level_size = 1 << level_bits;
+    static constexpr std::size_t level_mask = level_size - 1;
+
+    typedef std::array<hook, level_size> level;
+
+    void insert(entry &e);
+
+    static void link(hook &head, hook &h);
+
+    static void unlink(hook &h);
+
+    /// Move all the nodes of a slot to an empty list.
+    static void splice(hook &slot, hook &list);
+
+    void start_timer();
+
+    void handle_timer(const boost::system::error_code &ec);
+
+    /// Advance by one tick, cascading and expiring the slots it reaches.
+    void tick();
+
+    boost::asio::steady_timer timer_;
+
+    const clock::duration resolution_;
+
+    /// Ticks elapsed since the wheel was created, and when the last one happened.
+    std::size_t now_;
+    clock::time_point last_tick_;
+
+    level near_;
+    level far_;
+
+    std::size_t size_;
+    bool running_;
+};
+}
+}
+
+#endif // TIMING_WHEEL_HPP
@@ -12,7 +12,7 @@
 http::server::uri_matchers::regex::regex() : matcher() {}
 
 bool http::server::uri_matchers::regex::matches(const http::server::request &req) const {
-    return req.method == method_ && std::regex_match(req.uri, pattern_);
+    return req.method == method_ && std::regex_match(req.uri.begin(), req.uri.end(), pattern_);
 }
 
 http::server::uri_matchers::folder::folder() : matcher() {}
@@ -21,14 +21,18 @@ http::server::uri_matchers::folder::folder(const std::string &doc_root) : matche
 
 bool http::server::uri_matchers::folder::matches(const http::server::request &req) const {
     bool method_ok = req.method == "GET";
-    boost::filesystem::path full_path = doc_root_ + req.uri;
+    boost::filesystem::path full_path = doc_root_ + req.uri.to_string();
     bool is_folder = boost::filesystem::exists(full_path) && boost::filesystem::is_directory(full_path);
     return method_ok && is_folder;
 }
 
 http::server::user_handler::user_handler(std::unique_ptr<http::server::uri_matchers::matcher> matcher,
-                                         http::server::user_handler::handler func)
-    : matcher_(std::move(matcher)), handler_func_(func) {}
+                                         http::server::user_handler::handler func, bool blocking)
+    : matcher_(std::move(matcher)), handler_func_(func), blocking_(blocking) {}
+
+http::server::user_handler::user_handler(std::unique_ptr<http::server::uri_matchers::matcher> matcher,
+                                         http::server::user_handler::async_handler func)
+    : matcher_(std::move(matcher)), async_handler_func_(func) {}
 
 http::server::user_handler::user_handler(http::server::user_handler &&other) {
     if (this != &other) {
@@ -39,6 +43,11 @@ http::server::user_handler::user_handler(http::server::user_handler &&other) {
 http::server::user_handler &http::server::user_handler::operator=(http::server::user_handler &&other) {
     matcher_ = std::move(other.matcher_);
     handler_func_ = std::move(other.handler_func_);
+    async_handler_func_ = std::move(other.async_handler_func_);
+    body_handler_func_ = std::move(other.body_handler_func_);
+    body_file_func_ = std::move(other.body_file_func_);
+    body_check_func_ = std::move(other.body_check_func_);
+    blocking_ = other.blocking_;
     return *this;
 }
 
@@ -47,3 +56,8 @@ bool http::server::user_handler::matches(const http::server::request &req) const
 void http::server::user_handler::invoke(http::server::request &req, http::server::reply &rep) const {
     handler_func_(std::forward<decltype(req)>(req), std::forward<decltype(rep)>(rep));
 }
+
+void http::server::user_handler::invoke(http::server::request &req, http::server::reply &rep,
+                                        http::server::user_handler::completion done) const {
+    async_handler_func_(req, rep, std::move(done));
+}
@@ -12,8 +12,10 @@
 #define USER_HANDLER_H
 #include "reply.hpp"
 #include "request.hpp"
+#include <cstddef>
 #include <functional>
 #include <regex>
+#include <string>
 
 namespace http {
 namespace server {
@@ -51,8 +53,40 @@ class folder : public matcher {
 struct user_handler {
     public:
     typedef std::function<void(request &, reply &)> handler;
+
+    /// Completes the reply of an asynchronous handler. It may be called from any thread, and only the first call
+    /// counts. The request and the reply must not be touched once it has been called.
+    typedef std::function<void()> completion;
+
+    /// A handler whose reply may be completed after it returns, for example once another service has answered.
+    /// Its connection waits without holding a thread, and the reply is sent once the completion is called.
+    typedef std::function<void(request &, reply &, completion)> async_handler;
+
+    /// Receives the body of a request piece by piece as it is read, on the io thread of the connection, before
+    /// the handler is invoked. The body is then not kept in request::body, so it is not bounded by
+    /// server_options::max_request_body_size.
+    typedef std::function<void(request &, const char *, std::size_t)> body_handler;
+
+    /// Chooses the file, created or truncated, that the body of a request is stored in instead of request::body,
+    /// or returns an empty path to keep it in memory. Bodies of known length on plain HTTP connections are moved
+    /// from the socket to the file with splice(), without being copied through the process. Stored bodies are not
+    /// bounded by server_options::max_request_body_size.
+    typedef std::function<std::string(const request &)> body_file_chooser;
+
+    /// Decides from the request line and headers, before any of the body is read, whether the body is wanted.
+    /// Returns true to read it, or false to answer with rep at once; a client that sent Expect: 100-continue
+    /// then never sends the body. A rep left without a status becomes a 417 Expectation Failed.
+    typedef std::function<bool(const request &, reply &)> body_check;
+
     user_handler() = default;
-    user_handler(std::unique_ptr<uri_matchers::matcher> matcher, handler func);
+    /// A blocking handler (one that does disk or network I/O, or is otherwise slow) runs on the server's
+    /// blocking pool instead of the io thread of its connection.
+    user_handler(std::unique_ptr<uri_matchers::matcher> matcher, handler func, bool blocking = false);
+
+    /// An asynchronous handler runs on the io thread of its connection and must not block: it starts the work
+    /// and returns.
+    user_handler(std::unique_ptr<uri_matchers::matcher> matcher, async_handler func);
+
     user_handler(const user_handler &) = delete;
     user_handler &operator=(const user_handler &) = delete;
     user_handler(user_handler &&other);
@@ -64,9 +98,42 @@ struct user_handler {
     /// Simply invokes the user handler.
     void invoke(request &req, reply &rep) const;
 
+    /// Invokes an asynchronous user handler.
+    void invoke(request &req, reply &rep, completion done) const;
+
+    /// Whether the handler must be kept off the io threads.
+    bool is_blocking() const { return blocking_; }
+
+    /// Whether the handler completes its reply through a completion.
+    bool is_async() const { return static_cast<bool>(async_handler_func_); }
+
+    /// Have the bodies of the requests of this handler delivered to func as they are read.
+    void set_body_handler(body_handler func) { body_handler_func_ = std::move(func); }
+
+    /// The body handler, or nullptr if the bodies are kept in request::body.
+    const body_handler *get_body_handler() const { return body_handler_func_ ? &body_handler_func_ : nullptr; }
+
+    /// Have the bodies of the requests of this handler stored in the files func chooses. It takes precedence over
+    /// the body handler.
+    void set_body_file(body_file_chooser func) { body_file_func_ = std::move(func); }
+
+    /// The file the body of a request is to be stored in, or an empty path.
+    std::string get_body_file(const request &req) const { return body_file_func_ ? body_file_func_(req) : ""; }
+
+    /// Have the requests of this handler that have a body checked by func before the body is read.
+    void set_body_check(body_check func) { body_check_func_ = std::move(func); }
+
+    /// Whether the body of a request is wanted. Fills in rep if it is not.
+    bool accepts_body(const request &req, reply &rep) const { return !body_check_func_ || body_check_func_(req, rep); }
+
     private:
     std::unique_ptr<uri_matchers::matcher> matcher_;
     handler handler_func_;
+    async_handler async_handler_func_;
+    body_handler body_handler_func_;
+    body_file_chooser body_file_func_;
+    body_check body_check_func_;
+    bool blocking_ = false;
 };
 
 typedef std::unique_ptr<uri_matchers::matcher> matcher_ptr;
@@ -0,0 +1,76 @@
+//
+// worker.hpp
+// ~~~~~~~~~~
+//
+// Copyright (c) 2016 Vladimir Voinea (voineavladimir@gmail.com)
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#ifndef WORKER_HPP
+#define WORKER_HPP
+
+#include "connection_pool.hpp"
+#include "timing_wheel.hpp"
+#include <atomic>
+#include <boost/asio/io_service.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/version.hpp>
+#include <cstddef>
+
+#if defined(THOR_HAS_IO_URING) && BOOST_VERSION < 107800
+#error "The io_uring backend requires Boost 1.78 or newer"
+#endif
+
+namespace http {
+namespace server {
+
+/// Load counters of one io_service. They are updated by the connections running on it and read by the
+/// io_service_pool when it places new connections.
+struct io_service_load {
+    /// Connections currently running on the io_service.
+    std::atomic<std::size_t> connections{0};
+
+    /// Responses that are being produced or written: from the moment a request is complete until its
+    /// reply, including any sendfile, has been handed to the socket.
+    std::atomic<std::size_t> queued_handlers{0};
+};
+
+/// One io_service of the pool together with the state shared by all the connections it runs.
+struct worker : private boost::noncopyable {
+    worker(std::size_t index, int cpu, std::atomic<std::size_t> &pool_connections)
+        : timers(io_service), index(index), cpu(cpu), pool_connections(pool_connections) {}
+
+    /// Pooled connections own sockets on the io_service, so they are deleted before it. Connections released
+    /// while the io_service is destroyed are deleted right away.
+    ~worker() { connections.shutdown(); }
+
+    /// Finished connections of the worker, ready for new accepts. Declared first so that it outlives the
+    /// io_service and the connections its handlers still hold.
+    connection_pool connections;
+
+    /// Also declared before the io_service: the connections destroyed along with it update the counters.
+    io_service_load load;
+
+    /// Set when the server is shutting down gracefully: connections finish their current response and close.
+    std::atomic<bool> draining{false};
+
+    boost::asio::io_service io_service;
+
+    /// The idle and header read timeouts of the worker's connections.
+    timing_wheel timers;
+
+    /// The position of the worker in the io_service_pool.
+    const std::size_t index;
+
+    /// The CPU the worker's thread is pinned to, or -1.
+    const int cpu;
+
+    /// Connections running on all the workers of the pool.
+    std::atomic<std::size_t> &pool_connections;
+};
+}
+}
+
+#endif // WORKER_HPP